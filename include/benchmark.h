@@ -0,0 +1,176 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <epoxy/gl.h>
+#include <epoxy/glx.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+//Records how long each frame takes on the CPU, in buffer swap, and on the GPU,
+//then boils it all down into percentiles at the end.
+//Per frame, call beginFrame() before drawing, endRender() after the last draw call
+//and endFrame() after swapping buffers.
+class Benchmark{
+	public:
+		struct FrameSample{
+			double cpuMs; //From beginFrame() to endRender(): building and submitting the frame
+			double swapMs; //From endRender() to endFrame(): waiting on the swap (or flush)
+			double gpuMs; //GPU time between beginFrame() and endRender(), from a timer query
+			double frameMs; //Total from this frame's beginFrame() to the next one's
+		};
+		std::vector<FrameSample> samples;
+
+		Benchmark(){
+			glGenQueries(QUERY_COUNT, queries);
+		}
+
+		~Benchmark(){
+			glDeleteQueries(QUERY_COUNT, queries);
+		}
+
+		void beginFrame(){
+			Clock::time_point now = Clock::now();
+			if(!samples.empty()){
+				samples.back().frameMs = milliseconds(frameStart, now);
+			}
+			frameStart = now;
+			samples.push_back(FrameSample{0.0, 0.0, 0.0, 0.0});
+
+			//Timer queries come back a few frames late. Reading them right away would
+			//stall until the GPU caught up, so keep a ring of them and only collect
+			//the result when we need the slot again.
+			size_t frame = samples.size() - 1;
+			if(frame >= QUERY_COUNT){
+				collectQuery(frame - QUERY_COUNT);
+			}
+			glBeginQuery(GL_TIME_ELAPSED, queries[frame % QUERY_COUNT]);
+		}
+
+		void endRender(){
+			glEndQuery(GL_TIME_ELAPSED);
+			renderEnd = Clock::now();
+			samples.back().cpuMs = milliseconds(frameStart, renderEnd);
+		}
+
+		void endFrame(){
+			samples.back().swapMs = milliseconds(renderEnd, Clock::now());
+		}
+
+		//Collect the outstanding timer queries. Call once after the last frame.
+		void finish(){
+			if(samples.empty()) return;
+			samples.back().frameMs = milliseconds(frameStart, Clock::now());
+			size_t first = samples.size() > QUERY_COUNT ? samples.size() - QUERY_COUNT : 0;
+			for(size_t frame = first; frame < samples.size(); frame++){
+				collectQuery(frame);
+			}
+		}
+
+		void report(std::ostream &out) const{
+			out << "Benchmark: " << samples.size() << " frames\n"
+				<< std::setw(8) << "" << std::setw(10) << "mean" << std::setw(10) << "p50"
+				<< std::setw(10) << "p95" << std::setw(10) << "p99" << std::setw(10) << "max" << " (ms)\n";
+			const char* names[] = {"cpu", "swap", "gpu", "frame"};
+			for(int field = 0; field < 4; field++){
+				Summary summary = summarize(field);
+				out << std::setw(8) << names[field] << std::fixed << std::setprecision(3)
+					<< std::setw(10) << summary.mean << std::setw(10) << summary.p50
+					<< std::setw(10) << summary.p95 << std::setw(10) << summary.p99
+					<< std::setw(10) << summary.max << "\n";
+			}
+			out << std::defaultfloat << std::flush;
+		}
+
+		//One row per frame, for plotting
+		bool writeCSV(const std::string &path) const{
+			std::ofstream file(path);
+			file << "frame,cpu_ms,swap_ms,gpu_ms,frame_ms\n";
+			for(size_t i = 0; i < samples.size(); i++){
+				const FrameSample &sample = samples[i];
+				file << i << "," << sample.cpuMs << "," << sample.swapMs << ","
+					<< sample.gpuMs << "," << sample.frameMs << "\n";
+			}
+			return reportWrite(file, path);
+		}
+
+		//Just the summary, tagged with whatever describes the run (cube count etc.),
+		//so results from different builds can be compared by a script.
+		bool writeJSON(const std::string &path, const std::string &label) const{
+			std::ofstream file(path);
+			file << "{\n\t\"label\": \"" << label << "\",\n\t\"frames\": " << samples.size();
+			const char* names[] = {"cpu_ms", "swap_ms", "gpu_ms", "frame_ms"};
+			for(int field = 0; field < 4; field++){
+				Summary summary = summarize(field);
+				file << ",\n\t\"" << names[field] << "\": {\"mean\": " << summary.mean
+					<< ", \"p50\": " << summary.p50 << ", \"p95\": " << summary.p95
+					<< ", \"p99\": " << summary.p99 << ", \"max\": " << summary.max << "}";
+			}
+			file << "\n}\n";
+			return reportWrite(file, path);
+		}
+
+	private:
+		typedef std::chrono::steady_clock Clock;
+		static const size_t QUERY_COUNT = 8;
+		unsigned int queries[QUERY_COUNT];
+		Clock::time_point frameStart;
+		Clock::time_point renderEnd;
+
+		struct Summary{
+			double mean, p50, p95, p99, max;
+		};
+
+		static double milliseconds(Clock::time_point from, Clock::time_point to){
+			return std::chrono::duration<double, std::milli>(to - from).count();
+		}
+
+		void collectQuery(size_t frame){
+			uint64_t nanoseconds = 0;
+			glGetQueryObjectui64v(queries[frame % QUERY_COUNT], GL_QUERY_RESULT, &nanoseconds);
+			samples[frame].gpuMs = nanoseconds / 1.0e6;
+		}
+
+		//field picks a member of FrameSample, in declaration order
+		Summary summarize(int field) const{
+			Summary summary = {0.0, 0.0, 0.0, 0.0, 0.0};
+			if(samples.empty()) return summary;
+			std::vector<double> values;
+			values.reserve(samples.size());
+			for(const FrameSample &sample : samples){
+				const double fields[] = {sample.cpuMs, sample.swapMs, sample.gpuMs, sample.frameMs};
+				values.push_back(fields[field]);
+				summary.mean += fields[field];
+			}
+			summary.mean /= values.size();
+			std::sort(values.begin(), values.end());
+			summary.p50 = percentile(values, 0.50);
+			summary.p95 = percentile(values, 0.95);
+			summary.p99 = percentile(values, 0.99);
+			summary.max = values.back();
+			return summary;
+		}
+
+		//Nearest-rank percentile of already sorted values
+		static double percentile(const std::vector<double> &sorted, double fraction){
+			size_t rank = (size_t)std::ceil(fraction * sorted.size());
+			return sorted[rank > 0 ? rank - 1 : 0];
+		}
+
+		static bool reportWrite(const std::ofstream &file, const std::string &path){
+			if(!file){
+				std::cout << "ERROR: Couldn't write benchmark results to " << path << std::endl;
+				return false;
+			}
+			return true;
+		}
+};
+
+#endif
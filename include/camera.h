@@ -0,0 +1,137 @@
+#ifndef CAMERA_H
+#define CAMERA_H
+
+#include <cmath>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+//A first-person camera that remembers its matrices.
+//The view matrix only gets rebuilt after the camera moves or turns, and the
+//projection only after the viewport changes size, rather than every frame.
+class Camera{
+	public:
+		glm::vec3 up;
+		float fov; //Vertical, in degrees
+		float nearPlane;
+		float farPlane;
+
+		Camera(glm::vec3 position, float yaw, float pitch)
+			: up(0.0f, 1.0f, 0.0f), fov(45.0f), nearPlane(0.1f), farPlane(100.0f),
+			pos(position), yaw(yaw), pitch(pitch), aspect(16.0f / 9.0f),
+			viewDirty(true), projectionDirty(true), viewProjectionDirty(true), changeCount(0){
+			updateFront();
+		}
+
+		const glm::vec3& position() const{ return pos; }
+		const glm::vec3& front() const{ return frontDir; }
+		glm::vec3 right() const{ return glm::normalize(glm::cross(frontDir, up)); }
+
+		//Goes up every time the camera changes, so anything derived from it
+		//(like a uniform buffer) can tell when it needs refreshing
+		unsigned int version() const{ return changeCount; }
+
+		void setPosition(const glm::vec3 &position){
+			pos = position;
+			markViewDirty();
+		}
+		void move(const glm::vec3 &offset){
+			pos += offset;
+			markViewDirty();
+		}
+
+		//Turn by some number of degrees
+		void rotate(float yawOffset, float pitchOffset){
+			yaw += yawOffset;
+			pitch += pitchOffset;
+			//Don't allow the camera to flip over backwards or forwards
+			if(pitch > 89.0f) pitch = 89.0f;
+			if(pitch < -89.0f) pitch = -89.0f;
+			updateFront();
+			markViewDirty();
+		}
+
+		//Turn to face a point
+		void lookAt(const glm::vec3 &target){
+			glm::vec3 direction = glm::normalize(target - pos);
+			pitch = glm::degrees(asin(direction.y));
+			yaw = glm::degrees(atan2(direction.z, direction.x));
+			updateFront();
+			markViewDirty();
+		}
+
+		//Call whenever the framebuffer changes size
+		void setViewport(int width, int height){
+			if(width <= 0 || height <= 0) return; //Minimized
+			aspect = (float)width / (float)height;
+			projectionDirty = true;
+			changeCount++;
+		}
+
+		//View matrix: World space => Camera space
+		//"To move a camera backwards, is the same as moving the entire scene forward."
+		const glm::mat4& view() const{
+			if(viewDirty){
+				viewMatrix = glm::lookAt(pos, pos + frontDir, up);
+				viewDirty = false;
+				viewProjectionDirty = true;
+			}
+			return viewMatrix;
+		}
+
+		//Projection matrix: Camera space => Clip space
+		const glm::mat4& projection() const{
+			if(projectionDirty){
+				projectionMatrix = glm::perspective(glm::radians(fov), aspect, nearPlane, farPlane);
+				projectionDirty = false;
+				viewProjectionDirty = true;
+			}
+			return projectionMatrix;
+		}
+
+		const glm::mat4& viewProjection() const{
+			//Bring the other two up to date first; they flag us if they changed
+			view();
+			projection();
+			if(viewProjectionDirty){
+				viewProjectionMatrix = projectionMatrix * viewMatrix;
+				viewProjectionDirty = false;
+			}
+			return viewProjectionMatrix;
+		}
+
+	private:
+		glm::vec3 pos;
+		glm::vec3 frontDir;
+		float yaw; //Degrees. -90 points down the negative Z axis
+		float pitch;
+		float aspect;
+
+		mutable glm::mat4 viewMatrix;
+		mutable glm::mat4 projectionMatrix;
+		mutable glm::mat4 viewProjectionMatrix;
+		mutable bool viewDirty;
+		mutable bool projectionDirty;
+		mutable bool viewProjectionDirty;
+		unsigned int changeCount;
+
+		void markViewDirty(){
+			viewDirty = true;
+			changeCount++;
+		}
+
+		void updateFront(){
+			glm::vec3 direction;
+			//The math: Treat our facing direction as the hypotenuse of a right triangle,
+			//	and also suppose it's a normal vector with length 1.
+			//	Since the hypotenuse is 1, len(x) = cos theta and len(y) = sin theta.
+			//	("adjacent/hypotenuse" becomes "adjacent/1" becomes "adjacent", and so forth)
+			//	We have to consider both pitch and yaw, though.
+			direction.x = cos(glm::radians(yaw)) * cos(glm::radians(pitch));
+			direction.y = sin(glm::radians(pitch));
+			direction.z = sin(glm::radians(yaw)) * cos(glm::radians(pitch));
+			frontDir = glm::normalize(direction);
+		}
+};
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef CAMERAUNIFORMS_H
+#define CAMERAUNIFORMS_H
+
+#include <epoxy/gl.h>
+#include <epoxy/glx.h>
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstring>
+
+#include "camera.h"
+#include "framering.h"
+
+//Everything the shaders need to know about the camera this frame.
+//Has to match CameraBlock in the shaders, laid out by std140 rules.
+struct CameraBlock{
+	glm::mat4 view;
+	glm::mat4 projection;
+	glm::mat4 viewProjection;
+	glm::vec4 position; //std140 pads a vec3 out to 16 bytes anyway, so w is just unused
+	float time;
+	float padding[3]; //Round the block up to a multiple of 16 bytes
+};
+
+//A uniform buffer holding the CameraBlock, bound to a fixed binding point.
+//We fill it in once per frame, and every ShaderProg that has called
+//bindUniformBlock("CameraBlock", CameraUniforms::BINDING) reads from it.
+class CameraUniforms{
+	public:
+		static const unsigned int BINDING = 0;
+		unsigned int UBO;
+		CameraBlock block;
+
+		CameraUniforms() : blockVersion(0), blockFilled(false), bufferCurrent(false){
+			glGenBuffers(1, &UBO);
+			glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+			glBufferData(GL_UNIFORM_BUFFER, sizeof(CameraBlock), NULL, GL_DYNAMIC_DRAW);
+			glBindBuffer(GL_UNIFORM_BUFFER, 0);
+			glBindBufferBase(GL_UNIFORM_BUFFER, BINDING, UBO);
+		}
+
+		~CameraUniforms(){
+			glDeleteBuffers(1, &UBO);
+		}
+
+		//If the camera hasn't changed since last time, only the time gets uploaded.
+		//Given a FrameRing, the whole block goes into this frame's part of it instead, and
+		//that's what gets bound (the block is small, so there's no point picking out the time).
+		void update(const Camera &camera, float time, FrameRing* ring = NULL){
+			block.time = time;
+			bool cameraChanged = !blockFilled || camera.version() != blockVersion;
+			if(cameraChanged){
+				block.view = camera.view();
+				block.projection = camera.projection();
+				block.viewProjection = camera.viewProjection();
+				block.position = glm::vec4(camera.position(), 1.0f);
+				blockVersion = camera.version();
+				blockFilled = true;
+			}
+			if(ring){
+				FrameRing::Allocation allocation = ring->allocateUniforms(sizeof(CameraBlock));
+				if(allocation.data){
+					memcpy(allocation.data, &block, sizeof(CameraBlock));
+					glBindBufferRange(GL_UNIFORM_BUFFER, BINDING, ring->buffer, allocation.offset, sizeof(CameraBlock));
+					bufferCurrent = false;
+					return;
+				}
+			}
+			//Back to our own buffer, in case the last frame bound a piece of the ring
+			glBindBufferBase(GL_UNIFORM_BUFFER, BINDING, UBO);
+			glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+			if(cameraChanged || !bufferCurrent){
+				glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(CameraBlock), &block);
+			} else {
+				glBufferSubData(GL_UNIFORM_BUFFER, offsetof(CameraBlock, time), sizeof(float), &block.time);
+			}
+			glBindBuffer(GL_UNIFORM_BUFFER, 0);
+			bufferCurrent = true;
+		}
+
+	private:
+		unsigned int blockVersion;
+		bool blockFilled;
+		bool bufferCurrent; //Whether UBO has everything but maybe the time up to date
+};
+
+#endif
@@ -3,102 +3,195 @@
 
 #include <epoxy/gl.h>
 #include <epoxy/glx.h>
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "meshdata.h"
+#include "quantize.h"
 
 class Cube{
 	public:
 		unsigned int VAO;
 		unsigned int VBO;
-		/* unsigned int EBO; */
-		Cube(){
+		unsigned int EBO;
+		int instanceCount;
+		//Radius of a sphere that holds the whole (unit) cube: half its diagonal, sqrt(3)/2
+		static constexpr float boundingRadius = 0.8660254f;
+		static const int VERTEX_COUNT = 24;
+		static const int INDEX_COUNT = 36;
+		//What the vertex shader needs to turn our positions back into object space
+		VertexQuantizer::Dequantization dequantization;
+
+		//quantized: store positions as 16-bit integers and texture coordinates as
+		//half floats, 12 bytes a vertex instead of 20
+		Cube(bool quantized = false){
 			//A Vertex Array Object: Keeps track of some state for us so we can
 			//	easily draw our cube more than once.
 			glGenVertexArrays(1, &VAO);
 			glBindVertexArray(VAO); //Bind it so we can put the forthcoming triangle in it.
 			//As long as it's bound, it'll remember the VBO and EBO stuff we define.
 
-			float vertices[] = {
+			const float* vertices = vertexData();
+
+			// A vertex buffer object id:
+			glGenBuffers(1, &VBO);
+			//Send the data to our buffer
+			glBindBuffer(GL_ARRAY_BUFFER, VBO); //Bind our buffer to GL_ARRAY_BUFFER.
+			if(quantized){
+				//The cube fills its box exactly, so every corner lands on 0 or 65535 and nothing moves
+				struct PackedVertex{
+					uint16_t position[4]; //The 4th is just padding, to keep the texture coordinates aligned
+					uint16_t texCoord[2];
+				};
+				const float boxMin[3] = {-0.5f, -0.5f, -0.5f}, boxMax[3] = {0.5f, 0.5f, 0.5f};
+				dequantization = VertexQuantizer::dequantization(boxMin, boxMax);
+				PackedVertex packed[VERTEX_COUNT];
+				for(int i = 0; i < VERTEX_COUNT; i++){
+					VertexQuantizer::position(&vertices[i * 5], dequantization, packed[i].position);
+					packed[i].position[3] = 0;
+					packed[i].texCoord[0] = VertexQuantizer::half(vertices[i * 5 + 3]);
+					packed[i].texCoord[1] = VertexQuantizer::half(vertices[i * 5 + 4]);
+				}
+				glBufferData(GL_ARRAY_BUFFER, sizeof(packed), packed, GL_STATIC_DRAW);
+				//GL_TRUE: GL turns 0-65535 into 0-1 for us
+				glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, position));
+				glEnableVertexAttribArray(0);
+				glVertexAttribPointer(1, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, texCoord));
+				glEnableVertexAttribArray(1);
+			} else {
+				dequantization = VertexQuantizer::identity();
+				//Copy the vertex data to the buffer currently bound to GL_ARRAY_BUFFER:
+				glBufferData(GL_ARRAY_BUFFER, VERTEX_COUNT * 5 * sizeof(float), vertices, GL_STATIC_DRAW); //GL_DYNAMIC_DRAW if we expect this to change a lot.
+				//Specify the format of our vertex data
+				//Position attribute
+				glVertexAttribPointer(0, //Location of starting attribute
+						3, //Size of a vertex attribute: 3 values for x, y, z
+						GL_FLOAT, //Type of the data
+						GL_FALSE, //Does the data need to be converted to floats?
+						5 * sizeof(float), //Stride: The space between consecutive vertex attributes
+						(void*)0); //Offset of where data begins in the buffer
+				glEnableVertexAttribArray(0);
+				//Texture coord attribute
+				glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5*sizeof(float), (void*)(3*sizeof(float)));
+				glEnableVertexAttribArray(1);
+			}
+
+			//But how do we break the cube up into triangles? Like this:
+			//Two per face, and a face's triangles sit next to each other and share an edge,
+			//so each of its 4 vertices goes through the vertex shader once and the second
+			//triangle finds two of its three already in the post-transform cache.
+			//No two faces share a vertex, so there's nothing to gain from ordering the faces.
+			unsigned short indices[INDEX_COUNT];
+			indexData(indices);
+			//An Element Buffer Object tells us which of the VBO vertices to draw in what order.
+			//(It's part of the VAO's state, so it has to be bound while the VAO is.)
+			glGenBuffers(1, &EBO);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+
+			//The per-instance model matrices come from setInstanceBuffer()
+			instanceCount = 0;
+			// Here we can unbind our VAO and make + bind the next one if we have more objects.
+			glBindVertexArray(0);
+
+		}
+
+		//Point the instance attributes at count model matrices that are already in a buffer
+		//somewhere, starting offset bytes in (a FrameRing allocation, say), so drawInstanced()
+		//can draw them all at once. Expects our VAO to be bound already.
+		//A mat4 attribute takes up four consecutive locations, one per column.
+		void setInstanceBuffer(unsigned int buffer, size_t offset, int count){
+			glBindBuffer(GL_ARRAY_BUFFER, buffer);
+			for(int i = 0; i < 4; i++){
+				glVertexAttribPointer(2 + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(offset + i * sizeof(glm::vec4)));
+				glEnableVertexAttribArray(2 + i);
+				glVertexAttribDivisor(2 + i, 1); //Advance once per instance instead of once per vertex
+			}
+			instanceCount = count;
+		}
+
+		//Expects our VAO to be bound already.
+		void draw(){
+			glDrawElements(GL_TRIANGLES, INDEX_COUNT, GL_UNSIGNED_SHORT, 0); //Primitive type, number of elements, index type, offset
+		}
+		void drawInstanced(){
+			glDrawElementsInstanced(GL_TRIANGLES, INDEX_COUNT, GL_UNSIGNED_SHORT, 0, instanceCount);
+		}
+
+		//The same cube for a GeometryArena, with nothing quantized
+		static MeshData meshData(){
+			MeshData data;
+			const float* vertices = vertexData();
+			for(int i = 0; i < VERTEX_COUNT; i++){
+				MeshVertex vertex;
+				memset(&vertex, 0, sizeof(vertex));
+				memcpy(vertex.position, &vertices[i * 5], sizeof(vertex.position));
+				memcpy(vertex.texCoord, &vertices[i * 5 + 3], sizeof(vertex.texCoord));
+				memset(vertex.color, 255, sizeof(vertex.color));
+				data.vertices.push_back(vertex);
+			}
+			unsigned short indices[INDEX_COUNT];
+			indexData(indices);
+			data.indices.assign(indices, indices + INDEX_COUNT);
+			return data;
+		}
+
+		~Cube(){
+			glDeleteVertexArrays(1, &VAO);
+			glDeleteBuffers(1, &VBO);
+			glDeleteBuffers(1, &EBO);
+		}
+	
+	private:
+		//x, y, z, then texture coordinates u, v, for each vertex
+		static const float* vertexData(){
+			//4 corners per face rather than 8 for the whole cube, since corners
+			//shared between faces still need different texture coordinates.
+			static const float vertices[] = {
 				-0.5f, -0.5f, -0.5f,  0.0f, 0.0f,
 				0.5f, -0.5f, -0.5f,  1.0f, 0.0f,
 				0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-				0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
 				-0.5f,  0.5f, -0.5f,  0.0f, 1.0f,
-				-0.5f, -0.5f, -0.5f,  0.0f, 0.0f,
 
 				-0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
 				0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
 				0.5f,  0.5f,  0.5f,  1.0f, 1.0f,
-				0.5f,  0.5f,  0.5f,  1.0f, 1.0f,
 				-0.5f,  0.5f,  0.5f,  0.0f, 1.0f,
-				-0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
 
 				-0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
 				-0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
 				-0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-				-0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
 				-0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
-				-0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
 
 				0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
 				0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
 				0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-				0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
 				0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
-				0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
 
 				-0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
 				0.5f, -0.5f, -0.5f,  1.0f, 1.0f,
 				0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
-				0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
 				-0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
-				-0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
 
 				-0.5f,  0.5f, -0.5f,  0.0f, 1.0f,
 				0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
 				0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-				0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-				-0.5f,  0.5f,  0.5f,  0.0f, 0.0f,
-				-0.5f,  0.5f, -0.5f,  0.0f, 1.0f
+				-0.5f,  0.5f,  0.5f,  0.0f, 0.0f
 			};
-
-			// A vertex buffer object id:
-			glGenBuffers(1, &VBO);
-			//Send the data to our buffer
-			glBindBuffer(GL_ARRAY_BUFFER, VBO); //Bind our buffer to GL_ARRAY_BUFFER.
-			//Copy the vertex data to the buffer currently bound to GL_ARRAY_BUFFER:
-			glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW); //GL_DYNAMIC_DRAW if we expect this to change a lot.
-			//Specify the format of our vertex data
-			//Position attribute
-			glVertexAttribPointer(0, //Location of starting attribute
-					3, //Size of a vertex attribute: 3 values for x, y, z
-					GL_FLOAT, //Type of the data
-					GL_FALSE, //Does the data need to be converted to floats?
-					5 * sizeof(float), //Stride: The space between consecutive vertex attributes
-					(void*)0); //Offset of where data begins in the buffer
-			glEnableVertexAttribArray(0);
-			//Texture coord attribute
-			glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5*sizeof(float), (void*)(3*sizeof(float)));
-			glEnableVertexAttribArray(1);
-
-			//But how do we break the cube up into triangles? Like this:
-			/* unsigned int indices[] = { */
-			/* 	0, 1, 3, */
-			/* 	1, 2, 3 */
-			/* }; */
-			//An Element Buffer Object tells us which of the VBO vertices to draw in what order.
-			/* glGenBuffers(1, &EBO); */
-			/* glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO); */
-			/* glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW); */
-			// Here we can unbind our VAO and make + bind the next one if we have more objects.
-
+			return vertices;
 		}
 
-		~Cube(){
-			glDeleteVertexArrays(1, &VAO);
-			glDeleteBuffers(1, &VBO);
-			/* glDeleteBuffers(1, &EBO); */
+		static void indexData(unsigned short* indices){
+			for(int face = 0; face < 6; face++){
+				const unsigned short corners[] = {0, 1, 2, 2, 3, 0};
+				for(int i = 0; i < 6; i++){
+					indices[face * 6 + i] = face * 4 + corners[i];
+				}
+			}
 		}
-	
 };
 
 #endif
-
@@ -0,0 +1,116 @@
+#ifndef DRAWCOMMANDS_H
+#define DRAWCOMMANDS_H
+
+#include <epoxy/gl.h>
+#include <epoxy/glx.h>
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "framering.h"
+#include "geometryarena.h"
+
+//Laid out exactly the way GL reads it out of a GL_DRAW_INDIRECT_BUFFER
+struct DrawElementsIndirectCommand{
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+//Draws every visible object in a GeometryArena, whatever mesh each one uses, as one
+//instanced command per mesh. build() sorts the visible list by mesh so each mesh's
+//instances sit next to each other, and works out which object goes in each instance slot.
+//
+//With ARB_multi_draw_indirect the commands go into the frame ring and the whole lot is
+//a single glMultiDrawElementsIndirect call, however many kinds of mesh there are.
+//Otherwise it's a glDrawElementsInstancedBaseVertex per command, with the instance
+//attributes moved along to each command's first instance (no base instance on 3.3).
+//
+//Per frame: build(), upload(), fill in instance data for order, flush the ring, submit().
+class DrawCommandBuilder{
+	public:
+		bool multiDrawIndirect;
+		std::vector<DrawElementsIndirectCommand> commands;
+		std::vector<uint32_t> commandMesh; //Which of the ranges each command draws
+		//Which object each instance slot is for, grouped by mesh
+		std::vector<uint32_t> order;
+
+		DrawCommandBuilder() : indirectOffset(SIZE_MAX){
+			//Base instances in the commands need 4.2 or ARB_base_instance as well
+			multiDrawIndirect = epoxy_gl_version() >= 43 ||
+				(epoxy_has_gl_extension("GL_ARB_multi_draw_indirect") &&
+				 (epoxy_gl_version() >= 42 || epoxy_has_gl_extension("GL_ARB_base_instance")));
+		}
+
+		//ranges: the arena's meshes. meshOf: which range each object uses.
+		//visible: the objects to draw, or NULL for the first count of them.
+		void build(const std::vector<GeometryRange> &ranges, const std::vector<uint32_t> &meshOf, const uint32_t* visible, size_t count){
+			//Counting sort: how many of each mesh, then where each mesh's run of slots starts
+			counts.assign(ranges.size() + 1, 0);
+			for(size_t i = 0; i < count; i++){
+				counts[meshOf[visible ? visible[i] : i] + 1]++;
+			}
+			commands.clear();
+			commandMesh.clear();
+			for(size_t mesh = 0; mesh < ranges.size(); mesh++){
+				uint32_t instances = counts[mesh + 1];
+				counts[mesh + 1] += counts[mesh];
+				if(instances == 0) continue;
+				DrawElementsIndirectCommand command;
+				command.count = ranges[mesh].indexCount;
+				command.instanceCount = instances;
+				command.firstIndex = ranges[mesh].firstIndex;
+				command.baseVertex = ranges[mesh].baseVertex;
+				command.baseInstance = counts[mesh];
+				commands.push_back(command);
+				commandMesh.push_back(mesh);
+			}
+			order.resize(count);
+			for(size_t i = 0; i < count; i++){
+				uint32_t object = visible ? visible[i] : i;
+				order[counts[meshOf[object]]++] = object;
+			}
+		}
+
+		//Copies the commands into this frame's part of the ring, when we'll be drawing indirect.
+		//Returns false if the ring was full, in which case submit() draws them one by one.
+		bool upload(FrameRing &ring){
+			indirectOffset = SIZE_MAX;
+			if(!multiDrawIndirect || commands.empty()) return true;
+			size_t size = commands.size() * sizeof(DrawElementsIndirectCommand);
+			FrameRing::Allocation allocation = ring.allocate(size, 4);
+			if(!allocation.data) return false;
+			memcpy(allocation.data, commands.data(), size);
+			indirectOffset = allocation.offset;
+			return true;
+		}
+
+		//Draws it all, with the instance data for order starting instanceOffset bytes into
+		//the ring. Expects the arena's VAO to be bound, and the ring to be flushed.
+		void submit(GeometryArena &arena, const FrameRing &ring, size_t instanceOffset){
+			if(commands.empty()) return;
+			if(indirectOffset != SIZE_MAX){
+				arena.setInstanceBuffer(ring.buffer, instanceOffset);
+				glBindBuffer(GL_DRAW_INDIRECT_BUFFER, ring.buffer);
+				glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)indirectOffset, commands.size(), 0);
+				glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+				return;
+			}
+			for(const DrawElementsIndirectCommand &command : commands){
+				arena.setInstanceBuffer(ring.buffer, instanceOffset + command.baseInstance * sizeof(glm::mat4));
+				glDrawElementsInstancedBaseVertex(GL_TRIANGLES, command.count, GL_UNSIGNED_INT,
+						(void*)(command.firstIndex * sizeof(uint32_t)), command.instanceCount, command.baseVertex);
+			}
+		}
+
+	private:
+		std::vector<uint32_t> counts;
+		size_t indirectOffset; //SIZE_MAX when there's nothing in the ring to draw from
+};
+
+#endif
@@ -0,0 +1,114 @@
+#ifndef FILEWATCHER_H
+#define FILEWATCHER_H
+
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+
+//Notices when files change, using inotify on a thread of its own, so nothing has to go
+//checking file times every frame. changed() just reads a flag.
+//
+//It watches each file's directory rather than the file itself: plenty of editors save by
+//writing a new file and renaming it over the old one, and a watch on the old file would
+//never hear about that.
+class FileWatcher{
+	public:
+		FileWatcher() : dirty(false){
+			inotifyFD = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+			if(inotifyFD < 0){
+				std::cout << "WARNING: Couldn't start watching files: " << strerror(errno) << std::endl;
+			}
+			//Writing to this wakes the thread up to quit
+			if(pipe(stopPipe) != 0){
+				stopPipe[0] = stopPipe[1] = -1;
+			}
+			if(inotifyFD >= 0 && stopPipe[0] >= 0){
+				thread = std::thread([this](){ run(); });
+			}
+		}
+
+		~FileWatcher(){
+			if(thread.joinable()){
+				char stop = 0;
+				if(write(stopPipe[1], &stop, 1) == 1) thread.join();
+				else thread.detach();
+			}
+			if(inotifyFD >= 0) close(inotifyFD);
+			if(stopPipe[0] >= 0){
+				close(stopPipe[0]);
+				close(stopPipe[1]);
+			}
+		}
+
+		FileWatcher(const FileWatcher&) = delete;
+		FileWatcher& operator=(const FileWatcher&) = delete;
+
+		//Start watching a file. Only its directory has to exist so far.
+		bool watch(const std::string &path){
+			if(inotifyFD < 0) return false;
+			size_t slash = path.find_last_of('/');
+			std::string directory = slash == std::string::npos ? "." : path.substr(0, slash);
+			std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+			//Finished writes, and files renamed over it. (Not IN_CREATE, which comes before anything's written.)
+			int descriptor = inotify_add_watch(inotifyFD, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+			if(descriptor < 0){
+				std::cout << "WARNING: Couldn't watch " << path << ": " << strerror(errno) << std::endl;
+				return false;
+			}
+			std::lock_guard<std::mutex> lock(mutex);
+			watched[descriptor].insert(name);
+			return true;
+		}
+
+		//Whether any watched file has changed since the last call. Never blocks.
+		bool changed(){
+			return dirty.exchange(false);
+		}
+
+	private:
+		int inotifyFD;
+		int stopPipe[2];
+		std::thread thread;
+		std::mutex mutex;
+		std::map<int, std::set<std::string>> watched; //File names we care about in each watched directory
+		std::atomic<bool> dirty;
+
+		void run(){
+			//Room for at least one event with the longest name there can be
+			alignas(inotify_event) char buffer[sizeof(inotify_event) + NAME_MAX + 1 + 4096];
+			pollfd fds[2] = {{inotifyFD, POLLIN, 0}, {stopPipe[0], POLLIN, 0}};
+			while(true){
+				if(poll(fds, 2, -1) < 0){
+					if(errno == EINTR) continue;
+					std::cout << "WARNING: Stopped watching files: " << strerror(errno) << std::endl;
+					return;
+				}
+				if(fds[1].revents) return;
+				ssize_t length;
+				while((length = read(inotifyFD, buffer, sizeof(buffer))) > 0){
+					std::lock_guard<std::mutex> lock(mutex);
+					for(char* at = buffer; at < buffer + length; ){
+						const inotify_event* event = (const inotify_event*)at;
+						auto directory = watched.find(event->wd);
+						if(event->len > 0 && directory != watched.end() && directory->second.count(event->name)){
+							dirty = true;
+						}
+						at += sizeof(inotify_event) + event->len;
+					}
+				}
+			}
+		}
+};
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include <epoxy/gl.h>
+#include <epoxy/glx.h>
+
+#include <iostream>
+
+//An offscreen render target: a color and a depth/stencil renderbuffer
+//behind a Framebuffer Object. Draw into it instead of the window.
+class Framebuffer{
+	public:
+		unsigned int FBO;
+		unsigned int colorRBO;
+		unsigned int depthRBO;
+		int width;
+		int height;
+
+		Framebuffer(int width, int height) : width(width), height(height){
+			glGenFramebuffers(1, &FBO);
+			glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+
+			//Renderbuffers rather than textures, since we never sample from these.
+			glGenRenderbuffers(1, &colorRBO);
+			glBindRenderbuffer(GL_RENDERBUFFER, colorRBO);
+			glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+			glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorRBO);
+
+			glGenRenderbuffers(1, &depthRBO);
+			glBindRenderbuffer(GL_RENDERBUFFER, depthRBO);
+			glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+			glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthRBO);
+
+			if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE){
+				std::cout << "ERROR: Offscreen framebuffer is incomplete" << std::endl;
+			}
+			//Back to drawing to the window until someone calls bind()
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			glBindRenderbuffer(GL_RENDERBUFFER, 0);
+		}
+
+		~Framebuffer(){
+			glDeleteFramebuffers(1, &FBO);
+			glDeleteRenderbuffers(1, &colorRBO);
+			glDeleteRenderbuffers(1, &depthRBO);
+		}
+
+		//Direct all drawing into this framebuffer
+		void bind(){
+			glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+			glViewport(0, 0, width, height);
+		}
+};
+
+#endif
@@ -0,0 +1,212 @@
+#ifndef FRAMECAPTURE_H
+#define FRAMECAPTURE_H
+
+#include <epoxy/gl.h>
+#include <epoxy/glx.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "framering.h"
+#include "pixelreadback.h"
+#include "pngwriter.h"
+
+//Saves every frame it's given, without the render loop waiting on the readback or the encoding.
+//
+//capture() queues a copy of the frame into the next of a ring of PixelReadbacks and moves on.
+//Each frame after, any copies that have landed get mapped and handed to the writer threads,
+//which write straight out of the mapping; the slot gets unmapped once its turn comes round
+//again. There's at least one more slot than the FrameRing has regions, and the frame ring
+//has waited on a later fence by then, so the copy has normally finished.
+//
+//capture() never waits on the GPU or the writers. If the oldest slot's copy still hasn't
+//landed, or the writers are a whole ring behind (say PNG encoding on too few cores), that
+//frame gets dropped instead, and counted in framesDropped().
+//
+//Frames go out either as numbered PNGs (prefix00000.png, prefix00001.png...) written on
+//several threads at once, or as raw RGBA frames, top row first, down a pipe to a command
+//such as ffmpeg. The pipe gets one writer so frames arrive in order. If that command might
+//exit early, ignore SIGPIPE first, or writing to it will kill the process.
+class FrameCapture{
+	public:
+		enum Mode{ PNG_SEQUENCE, RAW_PIPE };
+
+		//Fewest slots to keep a frame's copy in flight until the frame ring has caught up with it
+		static const int MIN_SLOTS = FrameRing::DEFAULT_REGION_COUNT + 1;
+
+		//target: the file name prefix for PNG_SEQUENCE, or the command to pipe to for RAW_PIPE.
+		//level: zlib compression level for the PNGs. Low is fast, which is what matters here.
+		FrameCapture(Mode mode, const std::string &target, int width, int height,
+				int slotCount = MIN_SLOTS, unsigned int writerCount = std::thread::hardware_concurrency(), int level = 1)
+			: mode(mode), target(target), width(width), height(height), level(level),
+			  next(0), frameCount(0), dropCount(0), pipe(NULL), stopping(false), finished(false){
+			for(int i = 0; i < std::max(MIN_SLOTS, slotCount); i++){
+				slots.emplace_back(new Slot());
+			}
+			if(mode == RAW_PIPE){
+				pipe = popen(target.c_str(), "w");
+				if(!pipe){
+					std::cout << "ERROR: Couldn't start \"" << target << "\" to capture frames to" << std::endl;
+				}
+				writerCount = 1;
+			}
+			for(unsigned int i = 0; i < std::max(1u, writerCount); i++){
+				writers.push_back(std::thread([this](){ writerLoop(); }));
+			}
+		}
+
+		~FrameCapture(){
+			finish();
+		}
+
+		FrameCapture(const FrameCapture&) = delete;
+		FrameCapture& operator=(const FrameCapture&) = delete;
+
+		//Queues up the frame in the read framebuffer, or drops it if the oldest slot is still
+		//busy. Call once a frame, after drawing and before swapping buffers.
+		void capture(){
+			collect();
+			Slot &slot = *slots[next];
+			//The oldest slot. collect() has handed it over if its copy landed.
+			bool busy = slot.reading;
+			if(!busy){
+				std::lock_guard<std::mutex> lock(mutex);
+				busy = slot.writing;
+			}
+			if(busy){
+				dropCount++;
+				return;
+			}
+			slot.readback.unmap();
+			slot.readback.start(0, 0, width, height);
+			slot.reading = true;
+			slot.frame = frameCount++;
+			next = (next + 1) % slots.size();
+		}
+
+		//Waits for every captured frame to be written out, and closes the pipe. Nothing can
+		//be captured after this.
+		void finish(){
+			if(finished) return;
+			finished = true;
+			for(size_t i = 0; i < slots.size(); i++){
+				Slot &slot = *slots[(next + i) % slots.size()];
+				if(slot.reading) hand(slot);
+			}
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				stopping = true;
+			}
+			jobAdded.notify_all();
+			for(std::thread &writer : writers){
+				writer.join();
+			}
+			for(std::unique_ptr<Slot> &slot : slots){
+				slot->readback.unmap();
+			}
+			if(pipe) pclose(pipe);
+			pipe = NULL;
+		}
+
+		int framesCaptured() const{ return frameCount; }
+		int framesDropped() const{ return dropCount; }
+
+	private:
+		struct Slot{
+			PixelReadback readback;
+			int frame;
+			bool reading; //The copy's been started but not mapped yet
+			bool writing; //A writer has the mapping. Guarded by mutex.
+			const unsigned char* pixels;
+
+			Slot() : frame(0), reading(false), writing(false), pixels(NULL){}
+		};
+
+		Mode mode;
+		std::string target;
+		int width;
+		int height;
+		int level;
+		std::vector<std::unique_ptr<Slot>> slots;
+		size_t next; //Slot for the next capture, and the oldest one in use
+		int frameCount;
+		int dropCount;
+		FILE* pipe;
+
+		std::vector<std::thread> writers;
+		std::mutex mutex;
+		std::condition_variable jobAdded;
+		std::deque<Slot*> jobs; //Oldest frame first
+		bool stopping;
+		bool finished;
+
+		//Hands every copy that's landed to the writers, oldest first. Stops at the first one
+		//that hasn't, so frames reach the writers in order.
+		void collect(){
+			for(size_t i = 0; i < slots.size(); i++){
+				Slot &slot = *slots[(next + i) % slots.size()];
+				if(!slot.reading) continue;
+				if(!slot.readback.ready()) break;
+				hand(slot);
+			}
+		}
+
+		//Maps a slot's copy (waiting on it if it must) and queues it for writing
+		void hand(Slot &slot){
+			slot.reading = false;
+			const unsigned char* pixels = slot.readback.map();
+			if(!pixels) return;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				slot.pixels = pixels;
+				slot.writing = true;
+				jobs.push_back(&slot);
+			}
+			jobAdded.notify_one();
+		}
+
+		void writerLoop(){
+			std::unique_lock<std::mutex> lock(mutex);
+			while(true){
+				jobAdded.wait(lock, [&](){ return stopping || !jobs.empty(); });
+				if(jobs.empty()) return; //Stopping, and nothing left to do
+				Slot &slot = *jobs.front();
+				jobs.pop_front();
+				lock.unlock();
+				write(slot);
+				lock.lock();
+				slot.writing = false;
+			}
+		}
+
+		//On a writer thread
+		void write(const Slot &slot){
+			if(mode == PNG_SEQUENCE){
+				char number[16];
+				snprintf(number, sizeof(number), "%05d", slot.frame);
+				PNGWriter::write(target + number + ".png", slot.pixels, width, height, 4, width * 4, true, true, level);
+				return;
+			}
+			if(!pipe) return;
+			//GL's rows are bottom first, everyone else's top first
+			size_t rowBytes = (size_t)width * 4;
+			for(int y = height - 1; y >= 0; y--){
+				if(fwrite(slot.pixels + y * rowBytes, 1, rowBytes, pipe) != rowBytes){
+					std::cout << "ERROR: Couldn't write frame " << slot.frame << " to \"" << target << "\", no more frames will be sent" << std::endl;
+					pclose(pipe);
+					pipe = NULL;
+					return;
+				}
+			}
+		}
+};
+
+#endif
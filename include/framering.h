@@ -0,0 +1,139 @@
+#ifndef FRAMERING_H
+#define FRAMERING_H
+
+#include <epoxy/gl.h>
+#include <epoxy/glx.h>
+
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+//One big buffer for data that changes every frame (instance matrices, uniform blocks...),
+//split into a region per frame in flight. Each frame hands out pieces of its own region,
+//and a fence at the end of the frame tells us when the GPU is done with it, so we never
+//write over anything it's still reading and never have to allocate or orphan a buffer.
+//
+//With ARB_buffer_storage the whole thing is mapped once and stays mapped, so allocate()
+//gives you a pointer straight into GPU-visible memory. On plain 3.3 it hands out pointers
+//into a copy in system memory instead, and flush() sends what's been written with glBufferSubData.
+//
+//Per frame: beginFrame(), allocate() as much as you like, flush() before drawing with it, endFrame().
+class FrameRing{
+	public:
+		struct Allocation{
+			void* data; //Where to write. NULL if the region was full.
+			size_t offset; //Where that is in the buffer, for glVertexAttribPointer, glBindBufferRange...
+			size_t size;
+		};
+
+		//Frames the CPU can get ahead of the GPU by before beginFrame() waits
+		static const int DEFAULT_REGION_COUNT = 3;
+
+		unsigned int buffer;
+		int uniformAlignment; //Uniform block offsets have to be a multiple of this
+
+		FrameRing(size_t regionSize, int regionCount = DEFAULT_REGION_COUNT)
+			: regionCount(regionCount), fences(regionCount, (GLsync)0), current(regionCount - 1), head(0), flushed(0){
+			glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformAlignment);
+			//Start every region on a boundary anything might need
+			this->regionSize = (regionSize + 255) & ~(size_t)255;
+			size_t totalSize = this->regionSize * regionCount;
+
+			glGenBuffers(1, &buffer);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+			persistent = epoxy_gl_version() >= 44 || epoxy_has_gl_extension("GL_ARB_buffer_storage");
+			if(persistent){
+				GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+				glBufferStorage(GL_COPY_WRITE_BUFFER, totalSize, NULL, flags);
+				memory = (unsigned char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, totalSize, flags);
+			} else {
+				glBufferData(GL_COPY_WRITE_BUFFER, totalSize, NULL, GL_STREAM_DRAW);
+				staging.resize(totalSize);
+				memory = staging.data();
+			}
+			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		}
+
+		~FrameRing(){
+			for(GLsync fence : fences){
+				if(fence) glDeleteSync(fence);
+			}
+			if(persistent){
+				glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+				glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+				glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+			}
+			glDeleteBuffers(1, &buffer);
+		}
+
+		FrameRing(const FrameRing&) = delete;
+		FrameRing& operator=(const FrameRing&) = delete;
+
+		//Move on to the next region, waiting for the GPU to finish with it first if it hasn't.
+		//With enough regions that should almost never actually wait.
+		void beginFrame(){
+			current = (current + 1) % regionCount;
+			if(fences[current]){
+				GLenum status = glClientWaitSync(fences[current], GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+				while(status == GL_TIMEOUT_EXPIRED){
+					status = glClientWaitSync(fences[current], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+				}
+				if(status == GL_WAIT_FAILED){
+					std::cout << "ERROR: Waiting on a frame ring fence failed" << std::endl;
+				}
+				glDeleteSync(fences[current]);
+				fences[current] = 0;
+			}
+			head = current * regionSize;
+			flushed = head;
+		}
+
+		//size bytes from this frame's region, starting on a multiple of alignment
+		Allocation allocate(size_t size, size_t alignment = 16){
+			Allocation allocation = {NULL, 0, size};
+			size_t offset = (head + alignment - 1) / alignment * alignment;
+			if(offset + size > (current + 1) * regionSize){
+				std::cout << "ERROR: Frame ring region is full (" << regionSize << " bytes)" << std::endl;
+				return allocation;
+			}
+			allocation.data = memory + offset;
+			allocation.offset = offset;
+			head = offset + size;
+			return allocation;
+		}
+
+		//For uniform blocks, which have their own alignment rules
+		Allocation allocateUniforms(size_t size){
+			return allocate(size, uniformAlignment);
+		}
+
+		//Make everything allocated so far visible to the GPU. A no-op when we're persistently mapped
+		//(the mapping is coherent), otherwise one glBufferSubData covering it all.
+		void flush(){
+			if(!persistent && head > flushed){
+				glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+				glBufferSubData(GL_COPY_WRITE_BUFFER, flushed, head - flushed, memory + flushed);
+				glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+			}
+			flushed = head;
+		}
+
+		//Call once this frame's draws have been issued
+		void endFrame(){
+			flush();
+			fences[current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		}
+
+	private:
+		size_t regionSize;
+		int regionCount;
+		std::vector<GLsync> fences; //One per region, set while the GPU might still be reading it
+		int current; //Region this frame is writing to
+		size_t head; //Next free byte in it
+		size_t flushed; //Everything before this has been sent (matters without persistent mapping)
+		bool persistent;
+		unsigned char* memory;
+		std::vector<unsigned char> staging; //System memory copy of the buffer, without persistent mapping
+};
+
+#endif
@@ -0,0 +1,216 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+//SSE2 is always there on x86-64. Anything else gets the plain C++ path.
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "jobsystem.h"
+
+//The six planes bounding what the camera can see, pulled straight out of the
+//view-projection matrix (Gribb & Hartmann). Each plane is (a, b, c, d) with the
+//normal pointing inwards, so a point p is inside when a*p.x + b*p.y + c*p.z + d >= 0.
+struct Frustum{
+	float planes[6][4];
+
+	Frustum(const glm::mat4 &viewProjection){
+		//glm is column-major, so row i of the matrix is m[0][i], m[1][i], ...
+		const glm::mat4 &m = viewProjection;
+		for(int i = 0; i < 3; i++){
+			for(int side = 0; side < 2; side++){
+				float sign = side == 0 ? 1.0f : -1.0f; //Left/right, bottom/top, near/far
+				float* plane = planes[i * 2 + side];
+				for(int col = 0; col < 4; col++){
+					plane[col] = m[col][3] + sign * m[col][i];
+				}
+				//Normalize, so plugging a point in gives a real distance we can compare radii against
+				float length = std::sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+				for(int col = 0; col < 4; col++){
+					plane[col] /= length;
+				}
+			}
+		}
+	}
+};
+
+//Bounding spheres, kept as separate arrays of x, y, z and radius (structure of arrays)
+//so the culling kernels can load 4 or 8 of the same thing at once.
+//The arrays are padded to a multiple of 8 with spheres that always get culled.
+class BoundingSpheres{
+	public:
+		std::vector<float> x, y, z, radius;
+
+		size_t size() const{ return count; }
+
+		void resize(size_t newCount){
+			count = newCount;
+			size_t padded = (newCount + 7) & ~(size_t)7;
+			x.resize(padded, 0.0f);
+			y.resize(padded, 0.0f);
+			z.resize(padded, 0.0f);
+			radius.resize(padded, -INFINITY);
+			for(size_t i = newCount; i < padded; i++){
+				radius[i] = -INFINITY;
+			}
+		}
+
+		void set(size_t i, const glm::vec3 &center, float r){
+			x[i] = center.x;
+			y[i] = center.y;
+			z[i] = center.z;
+			radius[i] = r;
+		}
+
+		//A sphere around an object of a given local radius, wherever its model matrix puts it
+		void set(size_t i, const glm::mat4 &modelMatrix, float localRadius){
+			glm::vec3 center(modelMatrix[3][0], modelMatrix[3][1], modelMatrix[3][2]);
+			//Allow for scaling: take the longest of the three axes
+			float scale = 0.0f;
+			for(int axis = 0; axis < 3; axis++){
+				glm::vec3 column(modelMatrix[axis][0], modelMatrix[axis][1], modelMatrix[axis][2]);
+				scale = std::fmax(scale, glm::length(column));
+			}
+			set(i, center, localRadius * scale);
+		}
+
+	private:
+		size_t count = 0;
+};
+
+//Works out which spheres are at least partly inside a frustum.
+class FrustumCuller{
+	public:
+		//Fills visible with the index of every visible sphere, in order.
+		//Given a job system, big batches get split up across its threads.
+		static void cull(const Frustum &frustum, const BoundingSpheres &spheres, std::vector<uint32_t> &visible, JobSystem* jobs = NULL){
+			size_t count = spheres.size();
+			visible.resize(count);
+			if(!jobs || count <= CHUNK_SIZE){
+				visible.resize(cullRange(frustum, spheres, 0, count, visible.data()));
+				return;
+			}
+			//Each chunk writes what it finds starting where its own spheres start, so nobody
+			//overlaps, and then we close up the gaps in between.
+			size_t chunks = (count + CHUNK_SIZE - 1) / CHUNK_SIZE;
+			std::vector<size_t> found(chunks);
+			jobs->parallelFor(chunks, 1, [&](size_t begin, size_t end){
+				for(size_t c = begin; c < end; c++){
+					size_t first = c * CHUNK_SIZE;
+					found[c] = cullRange(frustum, spheres, first, std::min(first + CHUNK_SIZE, count), visible.data() + first);
+				}
+			});
+			size_t total = found[0];
+			for(size_t c = 1; c < chunks; c++){
+				memmove(visible.data() + total, visible.data() + c * CHUNK_SIZE, found[c] * sizeof(uint32_t));
+				total += found[c];
+			}
+			visible.resize(total);
+		}
+
+		//Writes the index of every visible sphere from first up to last to out. Returns how many.
+		//first must be a multiple of 8, and so must last unless it's the end.
+		static size_t cullRange(const Frustum &frustum, const BoundingSpheres &spheres, size_t first, size_t last, uint32_t* out){
+			uint32_t* start = out;
+			size_t i = first;
+#if defined(__SSE2__)
+			static const bool hasAVX = __builtin_cpu_supports("avx");
+			if(hasAVX){
+				i = cullAVX(frustum, spheres, i, last, out);
+			}
+			i = cullSSE(frustum, spheres, i, last, out);
+#endif
+			for(; i < last; i++){
+				if(sphereVisible(frustum, spheres.x[i], spheres.y[i], spheres.z[i], spheres.radius[i])){
+					*out++ = i;
+				}
+			}
+			return out - start;
+		}
+
+		static bool sphereVisible(const Frustum &frustum, float x, float y, float z, float radius){
+			for(int p = 0; p < 6; p++){
+				const float* plane = frustum.planes[p];
+				if(plane[0] * x + plane[1] * y + plane[2] * z + plane[3] < -radius) return false;
+			}
+			return true;
+		}
+
+	private:
+		//Spheres per job when culling in parallel (a multiple of 8, so the AVX path lines up)
+		static const size_t CHUNK_SIZE = 8192;
+
+#if defined(__SSE2__)
+		//4 spheres per step. Returns where it got up to.
+		static size_t cullSSE(const Frustum &frustum, const BoundingSpheres &spheres, size_t i, size_t last, uint32_t* &out){
+			__m128 planes[6][4];
+			for(int p = 0; p < 6; p++){
+				for(int c = 0; c < 4; c++){
+					planes[p][c] = _mm_set1_ps(frustum.planes[p][c]);
+				}
+			}
+			//The arrays are padded to a multiple of 8, so reading past size() is safe.
+			//Padding spheres have a radius of -infinity and never pass.
+			for(; i < last; i += 4){
+				__m128 x = _mm_loadu_ps(&spheres.x[i]);
+				__m128 y = _mm_loadu_ps(&spheres.y[i]);
+				__m128 z = _mm_loadu_ps(&spheres.z[i]);
+				__m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&spheres.radius[i]));
+				__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+				for(int p = 0; p < 6; p++){
+					__m128 distance = _mm_add_ps(
+						_mm_add_ps(_mm_mul_ps(planes[p][0], x), _mm_mul_ps(planes[p][1], y)),
+						_mm_add_ps(_mm_mul_ps(planes[p][2], z), planes[p][3]));
+					inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negRadius));
+				}
+				appendVisible(_mm_movemask_ps(inside), i, out);
+			}
+			return i;
+		}
+
+		//8 spheres per step
+		__attribute__((target("avx")))
+		static size_t cullAVX(const Frustum &frustum, const BoundingSpheres &spheres, size_t i, size_t last, uint32_t* &out){
+			__m256 planes[6][4];
+			for(int p = 0; p < 6; p++){
+				for(int c = 0; c < 4; c++){
+					planes[p][c] = _mm256_set1_ps(frustum.planes[p][c]);
+				}
+			}
+			for(; i + 8 <= spheres.x.size() && i < last; i += 8){
+				__m256 x = _mm256_loadu_ps(&spheres.x[i]);
+				__m256 y = _mm256_loadu_ps(&spheres.y[i]);
+				__m256 z = _mm256_loadu_ps(&spheres.z[i]);
+				__m256 negRadius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(&spheres.radius[i]));
+				__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+				for(int p = 0; p < 6; p++){
+					__m256 distance = _mm256_add_ps(
+						_mm256_add_ps(_mm256_mul_ps(planes[p][0], x), _mm256_mul_ps(planes[p][1], y)),
+						_mm256_add_ps(_mm256_mul_ps(planes[p][2], z), planes[p][3]));
+					inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negRadius, _CMP_GE_OQ));
+				}
+				appendVisible(_mm256_movemask_ps(inside), i, out);
+			}
+			return i;
+		}
+#endif
+
+		//One bit per sphere in mask, starting at index first
+		static void appendVisible(int mask, size_t first, uint32_t* &out){
+			while(mask){
+				int bit = __builtin_ctz(mask);
+				*out++ = first + bit;
+				mask &= mask - 1;
+			}
+		}
+};
+
+#endif
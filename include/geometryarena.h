@@ -0,0 +1,143 @@
+#ifndef GEOMETRYARENA_H
+#define GEOMETRYARENA_H
+
+#include <epoxy/gl.h>
+#include <epoxy/glx.h>
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "mesh.h"
+#include "meshdata.h"
+
+//Where one mesh ended up inside a GeometryArena
+struct GeometryRange{
+	int baseVertex; //Added to every index, so indices stay local to the mesh
+	unsigned int firstIndex;
+	unsigned int indexCount;
+	MeshBounds bounds;
+};
+
+//Every mesh's vertices in one big VBO and every mesh's indices in one big EBO, all in
+//the MeshVertex format, behind a single VAO. Switching between meshes is then just a
+//different baseVertex and firstIndex on the draw call rather than a VAO (and buffer)
+//bind, and it sets things up for drawing several meshes from one call later on.
+//
+//Indices are always stored as 32-bit, since the arena as a whole can easily need them.
+class GeometryArena{
+	public:
+		unsigned int VAO;
+		unsigned int VBO;
+		unsigned int EBO;
+
+		//Room to start with. Adding more than fits grows the buffers, which is a copy on the GPU.
+		GeometryArena(size_t maxVertices = 64 * 1024, size_t maxIndices = 256 * 1024)
+			: vertexCapacity(maxVertices), indexCapacity(maxIndices), vertexCount(0), indexCount(0){
+			glGenVertexArrays(1, &VAO);
+			glBindVertexArray(VAO);
+
+			glGenBuffers(1, &VBO);
+			glBindBuffer(GL_ARRAY_BUFFER, VBO);
+			glBufferData(GL_ARRAY_BUFFER, vertexCapacity * sizeof(MeshVertex), NULL, GL_STATIC_DRAW);
+			Mesh::setVertexAttributes(0);
+
+			glGenBuffers(1, &EBO);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCapacity * sizeof(uint32_t), NULL, GL_STATIC_DRAW);
+
+			glBindVertexArray(0);
+		}
+
+		~GeometryArena(){
+			glDeleteVertexArrays(1, &VAO);
+			glDeleteBuffers(1, &VBO);
+			glDeleteBuffers(1, &EBO);
+		}
+
+		GeometryArena(const GeometryArena&) = delete;
+		GeometryArena& operator=(const GeometryArena&) = delete;
+
+		//Copies a mesh in after everything already added and says where it went
+		GeometryRange add(const MeshBlobs &data){
+			if(vertexCount + data.vertexCount > vertexCapacity){
+				grow(VBO, vertexCapacity, vertexCount + data.vertexCount, sizeof(MeshVertex), vertexCount);
+			}
+			if(indexCount + data.indexCount > indexCapacity){
+				grow(EBO, indexCapacity, indexCount + data.indexCount, sizeof(uint32_t), indexCount);
+			}
+
+			GeometryRange range;
+			range.baseVertex = vertexCount;
+			range.firstIndex = indexCount;
+			range.indexCount = data.indexCount;
+			range.bounds = data.bounds;
+
+			glBindBuffer(GL_COPY_WRITE_BUFFER, VBO);
+			glBufferSubData(GL_COPY_WRITE_BUFFER, vertexCount * sizeof(MeshVertex), (size_t)data.vertexCount * sizeof(MeshVertex), data.vertices);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, EBO);
+			if(data.indexType == GL_UNSIGNED_SHORT){
+				const uint16_t* indices = (const uint16_t*)data.indices;
+				std::vector<uint32_t> widened(indices, indices + data.indexCount);
+				glBufferSubData(GL_COPY_WRITE_BUFFER, indexCount * sizeof(uint32_t), widened.size() * sizeof(uint32_t), widened.data());
+			} else {
+				glBufferSubData(GL_COPY_WRITE_BUFFER, indexCount * sizeof(uint32_t), (size_t)data.indexCount * sizeof(uint32_t), data.indices);
+			}
+			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+			vertexCount += data.vertexCount;
+			indexCount += data.indexCount;
+			return range;
+		}
+
+		//Point the instance attributes at matrices starting offset bytes into buffer,
+		//like Mesh::setInstanceBuffer. Expects our VAO to be bound already.
+		void setInstanceBuffer(unsigned int buffer, size_t offset){
+			glBindBuffer(GL_ARRAY_BUFFER, buffer);
+			for(int i = 0; i < 4; i++){
+				glVertexAttribPointer(2 + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(offset + i * sizeof(glm::vec4)));
+				glEnableVertexAttribArray(2 + i);
+				glVertexAttribDivisor(2 + i, 1);
+			}
+		}
+
+		//Expects our VAO to be bound already.
+		void draw(const GeometryRange &range){
+			glDrawElementsBaseVertex(GL_TRIANGLES, range.indexCount, GL_UNSIGNED_INT,
+					(void*)(range.firstIndex * sizeof(uint32_t)), range.baseVertex);
+		}
+
+	private:
+		size_t vertexCapacity;
+		size_t indexCapacity;
+		size_t vertexCount;
+		size_t indexCount;
+
+		//Swaps buffer for one at least needed elements big, keeping the first used elements.
+		//The VAO remembers the old buffer, so everything pointing at it gets pointed at the new one.
+		void grow(unsigned int &buffer, size_t &capacity, size_t needed, size_t elementSize, size_t used){
+			while(capacity < needed) capacity *= 2;
+			unsigned int bigger;
+			glGenBuffers(1, &bigger);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, bigger);
+			glBufferData(GL_COPY_WRITE_BUFFER, capacity * elementSize, NULL, GL_STATIC_DRAW);
+			glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, used * elementSize);
+			glBindBuffer(GL_COPY_READ_BUFFER, 0);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+			glDeleteBuffers(1, &buffer);
+			buffer = bigger;
+
+			glBindVertexArray(VAO);
+			if(&buffer == &EBO){
+				glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+			} else {
+				glBindBuffer(GL_ARRAY_BUFFER, VBO);
+				Mesh::setVertexAttributes(0);
+			}
+			glBindVertexArray(0);
+		}
+};
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef IMAGECOMPARE_H
+#define IMAGECOMPARE_H
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+
+//How far one RGBA8 image is from another, going by the red, green and blue channels.
+//Alpha is left out: what ends up in the framebuffer's alpha doesn't change what's seen.
+struct ImageDiff{
+	double meanSquaredError; //Per channel, in 0-255 units
+	double psnr; //In dB. Infinite when the images match exactly.
+	int maxError; //Biggest difference in any one channel
+	size_t pixelsDifferent; //Pixels with any difference at all
+};
+
+//Compares two images a frame's worth at a time, 4 pixels per step with SSE2, which keeps
+//a full-size comparison down to a millisecond or so. Without SSE2 it goes a pixel at a time.
+class ImageCompare{
+	public:
+		//a and b: pixelCount RGBA8 pixels each
+		static ImageDiff compare(const uint32_t* a, const uint32_t* b, size_t pixelCount){
+			uint64_t squaredSum = 0;
+			size_t pixelsDifferent = 0;
+			int maxChannel = 0;
+			size_t i = 0;
+#if defined(__SSE2__)
+			const __m128i colorMask = _mm_set1_epi32(0x00ffffff);
+			const __m128i zero = _mm_setzero_si128();
+			__m128i maxError = zero;
+			while(i + 4 <= pixelCount){
+				//Squares of up to 255 add up quickly, so widen the running sums every so often
+				__m128i sums = zero;
+				size_t end = std::min(pixelCount & ~(size_t)3, i + 4096);
+				for(; i < end; i += 4){
+					__m128i pa = _mm_and_si128(_mm_loadu_si128((const __m128i*)(a + i)), colorMask);
+					__m128i pb = _mm_and_si128(_mm_loadu_si128((const __m128i*)(b + i)), colorMask);
+					__m128i difference = _mm_or_si128(_mm_subs_epu8(pa, pb), _mm_subs_epu8(pb, pa));
+					maxError = _mm_max_epu8(maxError, difference);
+					__m128i low = _mm_unpacklo_epi8(difference, zero);
+					__m128i high = _mm_unpackhi_epi8(difference, zero);
+					sums = _mm_add_epi32(sums, _mm_madd_epi16(low, low));
+					sums = _mm_add_epi32(sums, _mm_madd_epi16(high, high));
+					int same = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(difference, zero)));
+					pixelsDifferent += 4 - __builtin_popcount(same);
+				}
+				uint32_t lanes[4];
+				_mm_storeu_si128((__m128i*)lanes, sums);
+				squaredSum += (uint64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+			}
+			unsigned char maxBytes[16];
+			_mm_storeu_si128((__m128i*)maxBytes, maxError);
+			for(int byte = 0; byte < 16; byte++){
+				maxChannel = std::max(maxChannel, (int)maxBytes[byte]);
+			}
+#endif
+			for(; i < pixelCount; i++){
+				bool different = false;
+				for(int channel = 0; channel < 3; channel++){
+					int difference = std::abs((int)((a[i] >> (channel * 8)) & 0xff) - (int)((b[i] >> (channel * 8)) & 0xff));
+					squaredSum += difference * difference;
+					maxChannel = std::max(maxChannel, difference);
+					different = different || difference != 0;
+				}
+				pixelsDifferent += different;
+			}
+
+			ImageDiff diff;
+			diff.meanSquaredError = pixelCount ? (double)squaredSum / (pixelCount * 3.0) : 0.0;
+			diff.psnr = diff.meanSquaredError > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / diff.meanSquaredError)
+				: std::numeric_limits<double>::infinity();
+			diff.maxError = maxChannel;
+			diff.pixelsDifferent = pixelsDifferent;
+			return diff;
+		}
+};
+
+#endif
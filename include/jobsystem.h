@@ -0,0 +1,187 @@
+#ifndef JOBSYSTEM_H
+#define JOBSYSTEM_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//A fixed pool of worker threads that share out work by stealing.
+//Every thread has its own queue of jobs. It pushes and pops at the back of its own
+//queue, and when that runs dry it steals from the front of somebody else's, so threads
+//mostly stay out of each other's way and only meet when the load is uneven.
+//
+//The thread calling parallelFor works through the jobs too rather than sitting idle.
+//None of this touches GL, so only hand it CPU work; the context stays with the main thread.
+class JobSystem{
+	public:
+		//workerCount threads on top of the caller's. With 0, everything just runs inline.
+		JobSystem(int workerCount = defaultWorkerCount()) : queues(std::max(workerCount, 0) + 1), queued(0), stopping(false){
+			for(int i = 0; i < workerCount; i++){
+				workers.emplace_back(&JobSystem::workerLoop, this, i + 1);
+			}
+		}
+
+		~JobSystem(){
+			{
+				std::lock_guard<std::mutex> lock(sleepMutex);
+				stopping = true;
+			}
+			wake.notify_all();
+			for(std::thread &worker : workers){
+				worker.join();
+			}
+		}
+
+		JobSystem(const JobSystem&) = delete;
+		JobSystem& operator=(const JobSystem&) = delete;
+
+		//One worker per core, leaving a core for the main thread
+		static int defaultWorkerCount(){
+			int cores = std::thread::hardware_concurrency();
+			return cores > 1 ? cores - 1 : 0;
+		}
+
+		int threadCount() const{ return workers.size() + 1; }
+
+		//Calls func(begin, end) on ranges covering [0, count), each at least grainSize long
+		//(except maybe the last), and returns once all of them have finished.
+		//Ranges run at the same time on different threads, so func mustn't write anything they share.
+		template<typename Func>
+		void parallelFor(size_t count, size_t grainSize, const Func &func){
+			if(count == 0) return;
+			grainSize = std::max<size_t>(grainSize, 1);
+			//A few chunks per thread, so there's still something to steal when some finish early
+			size_t chunks = std::min((count + grainSize - 1) / grainSize, (size_t)threadCount() * 4);
+			if(workers.empty() || chunks <= 1){
+				func((size_t)0, count);
+				return;
+			}
+			size_t chunkSize = (count + chunks - 1) / chunks;
+			chunks = (count + chunkSize - 1) / chunkSize;
+
+			std::atomic<size_t> pending(chunks);
+			//Count them before they're visible, so queued never drops below what's really there
+			queued.fetch_add(chunks);
+			Queue &queue = queues[currentIndex()];
+			{
+				std::lock_guard<std::mutex> lock(queue.mutex);
+				for(size_t begin = 0; begin < count; begin += chunkSize){
+					Job job;
+					job.run = &invoke<Func>;
+					job.func = &func;
+					job.begin = begin;
+					job.end = std::min(begin + chunkSize, count);
+					job.pending = &pending;
+					queue.jobs.push_back(job);
+				}
+			}
+			{
+				//Taking the lock means no worker can be between checking queued and going to sleep
+				std::lock_guard<std::mutex> lock(sleepMutex);
+			}
+			wake.notify_all();
+
+			//Help out until our own chunks are done. This may run other people's jobs
+			//too, which is fine: it's how nested parallelFor calls make progress.
+			while(pending.load(std::memory_order_acquire) > 0){
+				Job job;
+				if(takeJob(currentIndex(), job)){
+					run(job);
+				} else {
+					std::this_thread::yield();
+				}
+			}
+		}
+
+	private:
+		struct Job{
+			void (*run)(const void* func, size_t begin, size_t end);
+			const void* func;
+			size_t begin, end;
+			std::atomic<size_t>* pending; //Chunks of this job's parallelFor still to finish
+		};
+
+		struct Queue{
+			std::mutex mutex;
+			std::deque<Job> jobs;
+		};
+
+		std::vector<Queue> queues; //queues[0] is for any thread that isn't one of our workers
+		std::vector<std::thread> workers;
+		std::atomic<long> queued; //Jobs sitting in any queue
+		std::mutex sleepMutex;
+		std::condition_variable wake;
+		bool stopping;
+
+		//Which queue belongs to the current thread
+		struct ThreadSlot{
+			const JobSystem* owner;
+			int index;
+		};
+		static ThreadSlot& threadSlot(){
+			static thread_local ThreadSlot slot = {NULL, 0};
+			return slot;
+		}
+		int currentIndex() const{
+			const ThreadSlot &slot = threadSlot();
+			return slot.owner == this ? slot.index : 0;
+		}
+
+		//Calls through to the lambda without any std::function allocation
+		template<typename Func>
+		static void invoke(const void* func, size_t begin, size_t end){
+			(*static_cast<const Func*>(func))(begin, end);
+		}
+
+		static void run(const Job &job){
+			job.run(job.func, job.begin, job.end);
+			job.pending->fetch_sub(1, std::memory_order_release);
+		}
+
+		//Newest job from our own queue, or failing that the oldest from someone else's
+		bool takeJob(int self, Job &job){
+			{
+				Queue &own = queues[self];
+				std::lock_guard<std::mutex> lock(own.mutex);
+				if(!own.jobs.empty()){
+					job = own.jobs.back();
+					own.jobs.pop_back();
+					queued.fetch_sub(1);
+					return true;
+				}
+			}
+			for(size_t i = 1; i < queues.size(); i++){
+				Queue &victim = queues[(self + i) % queues.size()];
+				std::lock_guard<std::mutex> lock(victim.mutex);
+				if(!victim.jobs.empty()){
+					job = victim.jobs.front();
+					victim.jobs.pop_front();
+					queued.fetch_sub(1);
+					return true;
+				}
+			}
+			return false;
+		}
+
+		void workerLoop(int index){
+			threadSlot().owner = this;
+			threadSlot().index = index;
+			while(true){
+				Job job;
+				if(takeJob(index, job)){
+					run(job);
+					continue;
+				}
+				std::unique_lock<std::mutex> lock(sleepMutex);
+				wake.wait(lock, [this]{ return stopping || queued.load() > 0; });
+				if(stopping) return;
+			}
+		}
+};
+
+#endif
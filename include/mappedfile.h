@@ -0,0 +1,67 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstdint>
+
+//A whole file mapped read-only into memory. The OS pages it in as it's touched,
+//so nothing gets copied into a buffer of our own first.
+class MappedFile{
+	public:
+		MappedFile() : data(NULL), size(0), modified(0){}
+		~MappedFile(){ close(); }
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		const unsigned char* data;
+		size_t size;
+		int64_t modified; //Last modification time, in nanoseconds
+
+		bool open(const char* path){
+			close();
+			int fd = ::open(path, O_RDONLY);
+			if(fd < 0) return false;
+			struct stat info;
+			if(fstat(fd, &info) != 0){
+				::close(fd);
+				return false;
+			}
+			size = info.st_size;
+			modified = (int64_t)info.st_mtim.tv_sec * 1000000000 + info.st_mtim.tv_nsec;
+			if(size > 0){
+				void* mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+				if(mapping == MAP_FAILED){
+					::close(fd);
+					size = 0;
+					return false;
+				}
+				data = (const unsigned char*)mapping;
+				madvise(mapping, size, MADV_SEQUENTIAL); //We read front to back
+			}
+			::close(fd); //The mapping keeps the file alive on its own
+			return true;
+		}
+
+		void close(){
+			if(data) munmap((void*)data, size);
+			data = NULL;
+			size = 0;
+		}
+
+		//Size and modification time, without mapping anything
+		static bool fileInfo(const char* path, size_t &size, int64_t &modified){
+			struct stat info;
+			if(::stat(path, &info) != 0) return false;
+			size = info.st_size;
+			modified = (int64_t)info.st_mtim.tv_sec * 1000000000 + info.st_mtim.tv_nsec;
+			return true;
+		}
+};
+
+#endif
@@ -0,0 +1,140 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include <epoxy/gl.h>
+#include <epoxy/glx.h>
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "meshloader.h"
+#include "quantize.h"
+
+//MeshVertex squeezed down from 36 bytes to 20 (see quantize.h)
+struct PackedMeshVertex{
+	uint16_t position[4]; //0-65535 across the mesh's bounding box. The 4th is padding.
+	int8_t normal[4]; //-127-127. The 4th is padding.
+	uint16_t texCoord[2]; //Half floats
+	unsigned char color[4];
+};
+
+//A mesh on the GPU, from whatever a MeshLoader loaded.
+//Attributes line up with the cube's: position at 0, texture coordinates at 1 and the
+//instance matrix at 2 to 5, so the same shaders draw either. Normals go at 6 and colors at 7.
+//
+//A quantized mesh stores PackedMeshVertex instead, which is a lot less for the GPU to fetch.
+//Positions then need stretching back out in the vertex shader using dequantization.
+class Mesh{
+	public:
+		unsigned int VAO;
+		unsigned int VBO;
+		unsigned int EBO;
+		int indexCount;
+		GLenum indexType;
+		int instanceCount;
+		MeshBounds bounds;
+		VertexQuantizer::Dequantization dequantization;
+
+		Mesh(const MeshBlobs &data, bool quantized = false)
+			: indexCount(data.indexCount), indexType(data.indexType), instanceCount(0), bounds(data.bounds){
+			glGenVertexArrays(1, &VAO);
+			glBindVertexArray(VAO);
+
+			glGenBuffers(1, &VBO);
+			glBindBuffer(GL_ARRAY_BUFFER, VBO);
+			if(quantized){
+				dequantization = VertexQuantizer::dequantization(bounds.min, bounds.max);
+				std::vector<PackedMeshVertex> packed = pack(data.vertices, data.vertexCount, dequantization);
+				glBufferData(GL_ARRAY_BUFFER, packed.size() * sizeof(PackedMeshVertex), packed.data(), GL_STATIC_DRAW);
+			} else {
+				dequantization = VertexQuantizer::identity();
+				//Straight from wherever the loader has it, which may well be a mapped cache file
+				glBufferData(GL_ARRAY_BUFFER, (size_t)data.vertexCount * sizeof(MeshVertex), data.vertices, GL_STATIC_DRAW);
+			}
+			setVertexAttributes(0, quantized);
+
+			glGenBuffers(1, &EBO);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, data.indexBytes(), data.indices, GL_STATIC_DRAW);
+
+			glBindVertexArray(0);
+		}
+
+		~Mesh(){
+			glDeleteVertexArrays(1, &VAO);
+			glDeleteBuffers(1, &VBO);
+			glDeleteBuffers(1, &EBO);
+		}
+
+		Mesh(const Mesh&) = delete;
+		Mesh& operator=(const Mesh&) = delete;
+
+		//Point attributes 0, 1, 6 and 7 at MeshVertex (or PackedMeshVertex) data
+		//in the bound GL_ARRAY_BUFFER, starting offset bytes in
+		static void setVertexAttributes(size_t offset, bool quantized = false){
+			if(quantized){
+				const GLsizei stride = sizeof(PackedMeshVertex);
+				glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*)(offset + offsetof(PackedMeshVertex, position)));
+				glEnableVertexAttribArray(0);
+				glVertexAttribPointer(1, 2, GL_HALF_FLOAT, GL_FALSE, stride, (void*)(offset + offsetof(PackedMeshVertex, texCoord)));
+				glEnableVertexAttribArray(1);
+				glVertexAttribPointer(6, 3, GL_BYTE, GL_TRUE, stride, (void*)(offset + offsetof(PackedMeshVertex, normal)));
+				glEnableVertexAttribArray(6);
+				glVertexAttribPointer(7, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, (void*)(offset + offsetof(PackedMeshVertex, color)));
+				glEnableVertexAttribArray(7);
+				return;
+			}
+			const GLsizei stride = sizeof(MeshVertex);
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)(offset + offsetof(MeshVertex, position)));
+			glEnableVertexAttribArray(0);
+			glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (void*)(offset + offsetof(MeshVertex, texCoord)));
+			glEnableVertexAttribArray(1);
+			glVertexAttribPointer(6, 3, GL_FLOAT, GL_FALSE, stride, (void*)(offset + offsetof(MeshVertex, normal)));
+			glEnableVertexAttribArray(6);
+			//Bytes from 0 to 255, which the shader sees as 0 to 1
+			glVertexAttribPointer(7, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, (void*)(offset + offsetof(MeshVertex, color)));
+			glEnableVertexAttribArray(7);
+		}
+
+		static std::vector<PackedMeshVertex> pack(const MeshVertex* vertices, size_t count, const VertexQuantizer::Dequantization &box){
+			std::vector<PackedMeshVertex> packed(count);
+			for(size_t i = 0; i < count; i++){
+				const MeshVertex &in = vertices[i];
+				PackedMeshVertex &out = packed[i];
+				VertexQuantizer::position(in.position, box, out.position);
+				out.position[3] = 0;
+				for(int axis = 0; axis < 3; axis++){
+					out.normal[axis] = VertexQuantizer::snorm8(in.normal[axis]);
+				}
+				out.normal[3] = 0;
+				out.texCoord[0] = VertexQuantizer::half(in.texCoord[0]);
+				out.texCoord[1] = VertexQuantizer::half(in.texCoord[1]);
+				memcpy(out.color, in.color, sizeof(out.color));
+			}
+			return packed;
+		}
+
+		//Point the instance attributes at count matrices starting offset bytes into buffer,
+		//like Cube::setInstanceBuffer. Expects our VAO to be bound already.
+		void setInstanceBuffer(unsigned int buffer, size_t offset, int count){
+			glBindBuffer(GL_ARRAY_BUFFER, buffer);
+			for(int i = 0; i < 4; i++){
+				glVertexAttribPointer(2 + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(offset + i * sizeof(glm::vec4)));
+				glEnableVertexAttribArray(2 + i);
+				glVertexAttribDivisor(2 + i, 1);
+			}
+			instanceCount = count;
+		}
+
+		//Expects our VAO to be bound already.
+		void draw(){
+			glDrawElements(GL_TRIANGLES, indexCount, indexType, 0);
+		}
+		void drawInstanced(){
+			glDrawElementsInstanced(GL_TRIANGLES, indexCount, indexType, 0, instanceCount);
+		}
+};
+
+#endif
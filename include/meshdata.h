@@ -0,0 +1,80 @@
+#ifndef MESHDATA_H
+#define MESHDATA_H
+
+#include <epoxy/gl.h>
+#include <epoxy/glx.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//One vertex of a loaded mesh, laid out the way it goes to the GPU
+struct MeshVertex{
+	float position[3];
+	float normal[3];
+	float texCoord[2];
+	unsigned char color[4];
+};
+
+//Axis-aligned box around a mesh, and the radius of a sphere about the origin that holds it all
+struct MeshBounds{
+	float min[3];
+	float max[3];
+	float radius;
+
+	static MeshBounds of(const MeshVertex* vertices, size_t count){
+		MeshBounds bounds;
+		for(int axis = 0; axis < 3; axis++){
+			bounds.min[axis] = INFINITY;
+			bounds.max[axis] = -INFINITY;
+		}
+		float radiusSquared = 0.0f;
+		for(size_t i = 0; i < count; i++){
+			const float* p = vertices[i].position;
+			for(int axis = 0; axis < 3; axis++){
+				bounds.min[axis] = std::min(bounds.min[axis], p[axis]);
+				bounds.max[axis] = std::max(bounds.max[axis], p[axis]);
+			}
+			radiusSquared = std::max(radiusSquared, p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+		}
+		bounds.radius = std::sqrt(radiusSquared);
+		return bounds;
+	}
+};
+
+//Everything needed to upload a mesh, wherever it happens to live: in a MeshLoader's
+//own vectors, or straight out of a memory-mapped cache file.
+struct MeshBlobs{
+	const MeshVertex* vertices;
+	uint32_t vertexCount;
+	const void* indices;
+	uint32_t indexCount;
+	GLenum indexType; //GL_UNSIGNED_SHORT when every index fits in one, otherwise GL_UNSIGNED_INT
+	MeshBounds bounds;
+
+	size_t indexBytes() const{
+		return (size_t)indexCount * (indexType == GL_UNSIGNED_SHORT ? 2 : 4);
+	}
+};
+
+//A mesh built in code rather than loaded, like the cube, holding its own data
+struct MeshData{
+	std::vector<MeshVertex> vertices;
+	std::vector<uint32_t> indices;
+
+	//Only good for as long as this MeshData is
+	MeshBlobs blobs() const{
+		MeshBlobs result;
+		result.vertices = vertices.data();
+		result.vertexCount = vertices.size();
+		result.indices = indices.data();
+		result.indexCount = indices.size();
+		result.indexType = GL_UNSIGNED_INT;
+		result.bounds = MeshBounds::of(vertices.data(), vertices.size());
+		return result;
+	}
+};
+
+#endif
@@ -0,0 +1,698 @@
+#ifndef MESHLOADER_H
+#define MESHLOADER_H
+
+#include <epoxy/gl.h>
+#include <epoxy/glx.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "mappedfile.h"
+#include "meshdata.h"
+#include "vertexcache.h"
+
+//Open-addressed hash map from a vertex (or anything else made of plain 32-bit words)
+//to its index, for spotting duplicates. Keys are compared byte for byte.
+template<typename Key>
+class VertexMap{
+	public:
+		VertexMap(size_t expected = 0) : count(0){
+			size_t capacity = 1024;
+			while(capacity < expected * 2) capacity *= 2;
+			slots.assign(capacity, Slot{Key(), EMPTY});
+		}
+
+		//The index of a key equal to this one, if we've seen one. If not, this key
+		//gets remembered as index, and that's what comes back.
+		uint32_t insert(const Key &key, uint32_t index){
+			if((count + 1) * 2 > slots.size()) grow();
+			size_t mask = slots.size() - 1;
+			for(size_t i = hash(key) & mask;; i = (i + 1) & mask){
+				Slot &slot = slots[i];
+				if(slot.index == EMPTY){
+					slot.key = key;
+					slot.index = index;
+					count++;
+					return index;
+				}
+				if(memcmp(&slot.key, &key, sizeof(Key)) == 0) return slot.index;
+			}
+		}
+
+	private:
+		static const uint32_t EMPTY = UINT32_MAX;
+		struct Slot{
+			Key key;
+			uint32_t index;
+		};
+		std::vector<Slot> slots;
+		size_t count;
+
+		static uint64_t hash(const Key &key){
+			static_assert(sizeof(Key) % 4 == 0, "VertexMap keys have to be made of 32-bit words");
+			const unsigned char* bytes = (const unsigned char*)&key;
+			uint64_t hash = 0x9e3779b97f4a7c15ull;
+			for(size_t i = 0; i < sizeof(Key); i += 4){
+				uint32_t word;
+				memcpy(&word, bytes + i, 4);
+				hash = (hash ^ word) * 0xff51afd7ed558ccdull;
+				hash ^= hash >> 32;
+			}
+			return hash;
+		}
+
+		void grow(){
+			std::vector<Slot> old;
+			old.swap(slots);
+			slots.assign(old.size() * 2, Slot{Key(), EMPTY});
+			size_t mask = slots.size() - 1;
+			for(const Slot &slot : old){
+				if(slot.index == EMPTY) continue;
+				size_t i = hash(slot.key) & mask;
+				while(slots[i].index != EMPTY) i = (i + 1) & mask;
+				slots[i] = slot;
+			}
+		}
+};
+
+//Reads numbers and words out of a block of text in memory. Much quicker than
+//iostreams or strtod, since it doesn't care about locales or anything but plain numbers.
+class TextReader{
+	public:
+		int line; //For error messages
+
+		TextReader(const unsigned char* data, size_t size)
+			: line(1), pos((const char*)data), end((const char*)data + size){}
+
+		bool atEnd() const{ return pos >= end; }
+		char peek() const{ return pos < end ? *pos : '\0'; }
+		void advance(){ pos++; }
+		const char* position() const{ return pos; }
+
+		//Spaces and tabs, but not newlines
+		void skipSpaces(){
+			while(pos < end && (*pos == ' ' || *pos == '\t' || *pos == '\r')) pos++;
+		}
+
+		//Nothing more on this line but maybe a comment
+		bool atLineEnd(){
+			skipSpaces();
+			return pos >= end || *pos == '\n' || *pos == '#';
+		}
+
+		void nextLine(){
+			const char* newline = (const char*)memchr(pos, '\n', end - pos);
+			pos = newline ? newline + 1 : end;
+			line++;
+		}
+
+		//The next run of non-space characters
+		std::string word(){
+			skipSpaces();
+			const char* start = pos;
+			while(pos < end && *pos != ' ' && *pos != '\t' && *pos != '\r' && *pos != '\n') pos++;
+			return std::string(start, pos);
+		}
+
+		//Whether the next word is exactly this
+		bool keyword(const char* expected){
+			skipSpaces();
+			size_t length = strlen(expected);
+			if((size_t)(end - pos) < length || memcmp(pos, expected, length) != 0) return false;
+			const char* after = pos + length;
+			if(after < end && *after != ' ' && *after != '\t' && *after != '\r' && *after != '\n') return false;
+			pos = after;
+			return true;
+		}
+
+		bool readInt(long &out){
+			skipSpaces();
+			const char* p = pos;
+			bool negative = false;
+			if(p < end && (*p == '-' || *p == '+')){
+				negative = *p == '-';
+				p++;
+			}
+			if(p >= end || *p < '0' || *p > '9') return false;
+			long value = 0;
+			while(p < end && *p >= '0' && *p <= '9'){
+				value = value * 10 + (*p - '0');
+				p++;
+			}
+			out = negative ? -value : value;
+			pos = p;
+			return true;
+		}
+
+		//Plain decimal with an optional exponent. Up to 19 significant digits are kept,
+		//which is far more than a float can hold anyway.
+		bool readDouble(double &out){
+			skipSpaces();
+			const char* p = pos;
+			bool negative = false;
+			if(p < end && (*p == '-' || *p == '+')){
+				negative = *p == '-';
+				p++;
+			}
+			uint64_t mantissa = 0;
+			int digits = 0, exponent = 0;
+			bool any = false;
+			for(; p < end && *p >= '0' && *p <= '9'; p++){
+				any = true;
+				if(digits < 19){
+					mantissa = mantissa * 10 + (*p - '0');
+					if(mantissa) digits++;
+				} else {
+					exponent++;
+				}
+			}
+			if(p < end && *p == '.'){
+				for(p++; p < end && *p >= '0' && *p <= '9'; p++){
+					any = true;
+					if(digits < 19){
+						mantissa = mantissa * 10 + (*p - '0');
+						if(mantissa) digits++;
+						exponent--;
+					}
+				}
+			}
+			if(!any) return false;
+			if(p < end && (*p == 'e' || *p == 'E')){
+				pos = p + 1;
+				long power;
+				if(!readInt(power)) return false;
+				exponent += power;
+				p = pos;
+			}
+			double value = (double)mantissa;
+			//Powers of ten up to 22 are exact in a double, so those don't add any rounding
+			static const double powers[] = {
+				1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+				1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+			};
+			if(exponent < 0 && exponent >= -22) value /= powers[-exponent];
+			else if(exponent > 0 && exponent <= 22) value *= powers[exponent];
+			else if(exponent != 0) value *= std::pow(10.0, exponent);
+			out = negative ? -value : value;
+			pos = p;
+			return true;
+		}
+
+		bool readFloat(float &out){
+			double value;
+			if(!readDouble(value)) return false;
+			out = (float)value;
+			return true;
+		}
+
+	private:
+		const char* pos;
+		const char* end;
+};
+
+//Loads Wavefront .obj and .ply meshes into one interleaved vertex array and an index array.
+//Identical vertices get merged, and the triangles get put in an order the vertex cache
+//likes (see vertexcache.h). Since all that takes a while on big meshes, the result gets
+//saved next to the source as <file>.meshcache, and later loads just map that into memory
+//and hand it straight to glBufferData, as long as the source hasn't changed since.
+//
+//	MeshLoader loader;
+//	if(loader.load("models/bunny.ply")) mesh.reset(new Mesh(loader.data()));
+class MeshLoader{
+	public:
+		bool useCache; //Read and write .meshcache files
+
+		MeshLoader() : useCache(true){
+			memset(&blobs, 0, sizeof(blobs));
+		}
+
+		//Returns false, after saying why, if the file couldn't be loaded.
+		//The mesh stays in data() until the next load() or the loader goes away.
+		bool load(const std::string &path){
+			clear();
+			size_t sourceSize;
+			int64_t sourceModified;
+			if(!MappedFile::fileInfo(path.c_str(), sourceSize, sourceModified)){
+				std::cout << "ERROR: Couldn't find mesh " << path << std::endl;
+				return false;
+			}
+			std::string cachePath = path + ".meshcache";
+			if(useCache && loadCache(cachePath, sourceSize, sourceModified)){
+				return true;
+			}
+
+			MappedFile source;
+			if(!source.open(path.c_str())){
+				std::cout << "ERROR: Couldn't read mesh " << path << std::endl;
+				return false;
+			}
+			std::string extension = path.substr(std::min(path.size(), path.rfind('.')));
+			std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+			bool parsed;
+			if(extension == ".obj"){
+				parsed = parseOBJ(source, path);
+			} else if(extension == ".ply"){
+				parsed = parsePLY(source, path);
+			} else {
+				std::cout << "ERROR: Don't know how to load a mesh from " << path << std::endl;
+				return false;
+			}
+			source.close();
+			if(!parsed) return false;
+			if(indices.empty()){
+				std::cout << "ERROR: No triangles in " << path << std::endl;
+				return false;
+			}
+
+			float before = VertexCacheOptimizer::acmr(indices, vertices.size());
+			optimize();
+			float after = VertexCacheOptimizer::acmr(indices, vertices.size());
+			finish();
+			std::cout << "Loaded " << path << ": " << blobs.vertexCount << " vertices, " << blobs.indexCount / 3
+				<< " triangles, ACMR " << before << " -> " << after << std::endl;
+
+			if(useCache) saveCache(cachePath, sourceSize, sourceModified);
+			return true;
+		}
+
+		const MeshBlobs& data() const{ return blobs; }
+
+	private:
+		//Bump this whenever the cache layout or what goes into it changes
+		static const uint32_t CACHE_VERSION = 1;
+		struct CacheHeader{
+			char magic[4]; //"MSHC"
+			uint32_t version;
+			uint64_t sourceSize; //The source file this was made from, so we can tell if it's changed
+			int64_t sourceModified;
+			uint32_t vertexCount;
+			uint32_t indexCount;
+			uint32_t vertexSize; //sizeof(MeshVertex) when it was written
+			uint32_t indexType;
+			MeshBounds bounds;
+			uint32_t padding;
+			//Then vertexCount vertices, then indexCount indices
+		};
+
+		MeshBlobs blobs;
+		MappedFile cacheFile; //When we loaded from the cache, the data lives in here
+		std::vector<MeshVertex> vertices;
+		std::vector<uint32_t> indices;
+		std::vector<uint16_t> shortIndices;
+
+		void clear(){
+			cacheFile.close();
+			vertices.clear();
+			indices.clear();
+			shortIndices.clear();
+			memset(&blobs, 0, sizeof(blobs));
+		}
+
+		static MeshVertex defaultVertex(){
+			MeshVertex vertex;
+			memset(&vertex, 0, sizeof(vertex));
+			memset(vertex.color, 255, sizeof(vertex.color));
+			return vertex;
+		}
+
+		bool parseOBJ(const MappedFile &file, const std::string &path){
+			TextReader text(file.data, file.size);
+			std::vector<float> positions, texCoords, normals;
+			//One vertex per distinct position/texture coordinate/normal combination
+			struct Corner{
+				int32_t position, texCoord, normal;
+			};
+			VertexMap<Corner> corners(file.size / 64);
+			std::vector<uint32_t> polygon;
+
+			for(; !text.atEnd(); text.nextLine()){
+				if(text.keyword("v")){
+					float xyz[3];
+					if(!text.readFloat(xyz[0]) || !text.readFloat(xyz[1]) || !text.readFloat(xyz[2])){
+						return objError(path, text, "bad vertex position");
+					}
+					positions.insert(positions.end(), xyz, xyz + 3);
+				} else if(text.keyword("vt")){
+					float uv[2] = {0.0f, 0.0f};
+					if(!text.readFloat(uv[0])) return objError(path, text, "bad texture coordinate");
+					text.readFloat(uv[1]); //v is optional
+					texCoords.insert(texCoords.end(), uv, uv + 2);
+				} else if(text.keyword("vn")){
+					float xyz[3];
+					if(!text.readFloat(xyz[0]) || !text.readFloat(xyz[1]) || !text.readFloat(xyz[2])){
+						return objError(path, text, "bad normal");
+					}
+					normals.insert(normals.end(), xyz, xyz + 3);
+				} else if(text.keyword("f")){
+					polygon.clear();
+					while(!text.atLineEnd()){
+						//v, v/vt, v//vn or v/vt/vn, counting from 1, or back from the latest if negative
+						long v = 0, vt = 0, vn = 0;
+						if(!text.readInt(v)) return objError(path, text, "bad face");
+						if(text.peek() == '/'){
+							text.advance();
+							if(text.peek() != '/' && !text.readInt(vt)) return objError(path, text, "bad face");
+							if(text.peek() == '/'){
+								text.advance();
+								if(!text.readInt(vn)) return objError(path, text, "bad face");
+							}
+						}
+						Corner corner;
+						corner.position = objIndex(v, positions.size() / 3);
+						corner.texCoord = objIndex(vt, texCoords.size() / 2);
+						corner.normal = objIndex(vn, normals.size() / 3);
+						if(corner.position < 0 || (vt && corner.texCoord < 0) || (vn && corner.normal < 0)){
+							return objError(path, text, "face refers to a vertex that doesn't exist");
+						}
+
+						uint32_t index = corners.insert(corner, vertices.size());
+						if(index == vertices.size()){
+							MeshVertex vertex = defaultVertex();
+							memcpy(vertex.position, &positions[corner.position * 3], sizeof(vertex.position));
+							if(corner.texCoord >= 0) memcpy(vertex.texCoord, &texCoords[corner.texCoord * 2], sizeof(vertex.texCoord));
+							if(corner.normal >= 0) memcpy(vertex.normal, &normals[corner.normal * 3], sizeof(vertex.normal));
+							vertices.push_back(vertex);
+						}
+						polygon.push_back(index);
+					}
+					addPolygon(polygon);
+				}
+				//Anything else (objects, groups, materials, smoothing...) we don't use
+			}
+			return true;
+		}
+
+		//OBJ indices count from 1, or back from the end if they're negative. -1 if it's out of range (or 0, meaning none).
+		static int32_t objIndex(long index, size_t count){
+			if(index > 0 && (size_t)index <= count) return index - 1;
+			if(index < 0 && (size_t)-index <= count) return count + index;
+			return -1;
+		}
+
+		static bool objError(const std::string &path, const TextReader &text, const char* message){
+			std::cout << "ERROR: " << path << ":" << text.line << ": " << message << std::endl;
+			return false;
+		}
+
+		//Triangulate as a fan, which is right for anything convex (and that's nearly everything)
+		void addPolygon(const std::vector<uint32_t> &polygon){
+			for(size_t i = 2; i < polygon.size(); i++){
+				indices.push_back(polygon[0]);
+				indices.push_back(polygon[i - 1]);
+				indices.push_back(polygon[i]);
+			}
+		}
+
+		enum PlyType{ PLY_INT8, PLY_UINT8, PLY_INT16, PLY_UINT16, PLY_INT32, PLY_UINT32, PLY_FLOAT32, PLY_FLOAT64, PLY_INVALID };
+		//What a vertex property means to us
+		enum PlyRole{ PLY_IGNORE, PLY_X, PLY_Y, PLY_Z, PLY_NX, PLY_NY, PLY_NZ, PLY_U, PLY_V, PLY_RED, PLY_GREEN, PLY_BLUE, PLY_ALPHA };
+		struct PlyProperty{
+			std::string name;
+			PlyType type;
+			PlyType countType; //For lists, the type of the length in front. PLY_INVALID if it's not a list.
+			PlyRole role;
+		};
+		struct PlyElement{
+			std::string name;
+			size_t count;
+			std::vector<PlyProperty> properties;
+		};
+		enum PlyFormat{ PLY_ASCII, PLY_LITTLE_ENDIAN, PLY_BIG_ENDIAN };
+
+		static PlyType plyType(const std::string &name){
+			if(name == "char" || name == "int8") return PLY_INT8;
+			if(name == "uchar" || name == "uint8") return PLY_UINT8;
+			if(name == "short" || name == "int16") return PLY_INT16;
+			if(name == "ushort" || name == "uint16") return PLY_UINT16;
+			if(name == "int" || name == "int32") return PLY_INT32;
+			if(name == "uint" || name == "uint32") return PLY_UINT32;
+			if(name == "float" || name == "float32") return PLY_FLOAT32;
+			if(name == "double" || name == "float64") return PLY_FLOAT64;
+			return PLY_INVALID;
+		}
+
+		static PlyRole plyRole(const std::string &name){
+			static const struct{ const char* name; PlyRole role; } roles[] = {
+				{"x", PLY_X}, {"y", PLY_Y}, {"z", PLY_Z},
+				{"nx", PLY_NX}, {"ny", PLY_NY}, {"nz", PLY_NZ},
+				{"u", PLY_U}, {"s", PLY_U}, {"texture_u", PLY_U}, {"texture_s", PLY_U},
+				{"v", PLY_V}, {"t", PLY_V}, {"texture_v", PLY_V}, {"texture_t", PLY_V},
+				{"red", PLY_RED}, {"green", PLY_GREEN}, {"blue", PLY_BLUE}, {"alpha", PLY_ALPHA},
+				{"diffuse_red", PLY_RED}, {"diffuse_green", PLY_GREEN}, {"diffuse_blue", PLY_BLUE}
+			};
+			for(const auto &entry : roles){
+				if(name == entry.name) return entry.role;
+			}
+			return PLY_IGNORE;
+		}
+
+		//Reads one value from the body of a PLY file, in whichever format it's in
+		class PlyReader{
+			public:
+				PlyReader(TextReader &text, PlyFormat format)
+					: text(text), format(format), pos((const unsigned char*)text.position()), end(NULL){}
+
+				void setEnd(const unsigned char* fileEnd){ end = fileEnd; }
+
+				bool read(PlyType type, double &out){
+					if(format == PLY_ASCII) return text.readDouble(out);
+					static const size_t sizes[] = {1, 1, 2, 2, 4, 4, 4, 8};
+					size_t size = sizes[type];
+					if(pos + size > end) return false;
+					unsigned char bytes[8];
+					memcpy(bytes, pos, size);
+					pos += size;
+					//Everything we run on is little-endian
+					if(format == PLY_BIG_ENDIAN) std::reverse(bytes, bytes + size);
+					switch(type){
+						case PLY_INT8: out = (int8_t)bytes[0]; break;
+						case PLY_UINT8: out = bytes[0]; break;
+						case PLY_INT16: { int16_t v; memcpy(&v, bytes, 2); out = v; break; }
+						case PLY_UINT16: { uint16_t v; memcpy(&v, bytes, 2); out = v; break; }
+						case PLY_INT32: { int32_t v; memcpy(&v, bytes, 4); out = v; break; }
+						case PLY_UINT32: { uint32_t v; memcpy(&v, bytes, 4); out = v; break; }
+						case PLY_FLOAT32: { float v; memcpy(&v, bytes, 4); out = v; break; }
+						default: { double v; memcpy(&v, bytes, 8); out = v; break; }
+					}
+					return true;
+				}
+
+				//ASCII elements are one per line
+				void endElement(){
+					if(format == PLY_ASCII) text.nextLine();
+				}
+
+			private:
+				TextReader &text;
+				PlyFormat format;
+				const unsigned char* pos; //Where we are, for the binary formats
+				const unsigned char* end;
+		};
+
+		bool parsePLY(const MappedFile &file, const std::string &path){
+			TextReader text(file.data, file.size);
+			if(!text.keyword("ply")) return plyError(path, "not a PLY file");
+			text.nextLine();
+
+			PlyFormat format = PLY_ASCII;
+			std::vector<PlyElement> elements;
+			while(true){
+				if(text.atEnd()) return plyError(path, "header never ends");
+				if(text.keyword("end_header")){
+					text.nextLine();
+					break;
+				}
+				std::string keyword = text.word();
+				if(keyword == "format"){
+					std::string name = text.word();
+					if(name == "ascii") format = PLY_ASCII;
+					else if(name == "binary_little_endian") format = PLY_LITTLE_ENDIAN;
+					else if(name == "binary_big_endian") format = PLY_BIG_ENDIAN;
+					else return plyError(path, "unknown format");
+				} else if(keyword == "element"){
+					PlyElement element;
+					element.name = text.word();
+					long count;
+					if(!text.readInt(count) || count < 0) return plyError(path, "bad element count");
+					element.count = count;
+					elements.push_back(element);
+				} else if(keyword == "property"){
+					if(elements.empty()) return plyError(path, "property before any element");
+					PlyProperty property;
+					std::string type = text.word();
+					property.countType = PLY_INVALID;
+					if(type == "list"){
+						property.countType = plyType(text.word());
+						type = text.word();
+						if(property.countType == PLY_INVALID) return plyError(path, "bad list count type");
+					}
+					property.type = plyType(type);
+					if(property.type == PLY_INVALID) return plyError(path, "unknown property type");
+					property.name = text.word();
+					property.role = elements.back().name == "vertex" ? plyRole(property.name) : PLY_IGNORE;
+					elements.back().properties.push_back(property);
+				}
+				//comment, obj_info: nothing we need
+				text.nextLine();
+			}
+
+			PlyReader reader(text, format);
+			reader.setEnd(file.data + file.size);
+			std::vector<uint32_t> polygon;
+			//PLY vertices are already shared, but files often still repeat identical ones
+			std::vector<uint32_t> remap;
+			for(const PlyElement &element : elements){
+				bool isVertex = element.name == "vertex";
+				bool isFace = element.name == "face";
+				if(isVertex) remap.resize(element.count);
+				VertexMap<MeshVertex> unique(isVertex ? element.count : 0);
+				for(size_t i = 0; i < element.count; i++){
+					MeshVertex vertex = defaultVertex();
+					for(const PlyProperty &property : element.properties){
+						double value;
+						if(property.countType != PLY_INVALID){
+							double length;
+							if(!reader.read(property.countType, length)) return plyError(path, "file ends too soon");
+							bool indices = isFace && (property.name == "vertex_indices" || property.name == "vertex_index");
+							if(indices) polygon.clear();
+							for(long item = 0; item < (long)length; item++){
+								if(!reader.read(property.type, value)) return plyError(path, "file ends too soon");
+								if(indices){
+									if(value < 0 || value >= remap.size()) return plyError(path, "face refers to a vertex that doesn't exist");
+									polygon.push_back(remap[(size_t)value]);
+								}
+							}
+							if(indices) addPolygon(polygon);
+							continue;
+						}
+						if(!reader.read(property.type, value)) return plyError(path, "file ends too soon");
+						if(isVertex) setPlyProperty(vertex, property, value);
+					}
+					reader.endElement();
+					if(isVertex){
+						remap[i] = unique.insert(vertex, vertices.size());
+						if(remap[i] == vertices.size()) vertices.push_back(vertex);
+					}
+				}
+			}
+			return true;
+		}
+
+		static void setPlyProperty(MeshVertex &vertex, const PlyProperty &property, double value){
+			//Colors come as bytes, or sometimes as floats from 0 to 1
+			bool floatColor = property.type == PLY_FLOAT32 || property.type == PLY_FLOAT64;
+			unsigned char color = (unsigned char)std::min(255.0, std::max(0.0, floatColor ? value * 255.0 + 0.5 : value));
+			switch(property.role){
+				case PLY_X: vertex.position[0] = value; break;
+				case PLY_Y: vertex.position[1] = value; break;
+				case PLY_Z: vertex.position[2] = value; break;
+				case PLY_NX: vertex.normal[0] = value; break;
+				case PLY_NY: vertex.normal[1] = value; break;
+				case PLY_NZ: vertex.normal[2] = value; break;
+				case PLY_U: vertex.texCoord[0] = value; break;
+				case PLY_V: vertex.texCoord[1] = value; break;
+				case PLY_RED: vertex.color[0] = color; break;
+				case PLY_GREEN: vertex.color[1] = color; break;
+				case PLY_BLUE: vertex.color[2] = color; break;
+				case PLY_ALPHA: vertex.color[3] = color; break;
+				default: break;
+			}
+		}
+
+		static bool plyError(const std::string &path, const char* message){
+			std::cout << "ERROR: " << path << ": " << message << std::endl;
+			return false;
+		}
+
+		//Triangle order for the vertex cache, then vertex order to match
+		void optimize(){
+			VertexCacheOptimizer::optimize(indices, vertices.size());
+			std::vector<uint32_t> remap = VertexCacheOptimizer::fetchOrder(indices, vertices.size());
+			std::vector<MeshVertex> reordered(vertices.size());
+			for(size_t i = 0; i < vertices.size(); i++){
+				reordered[remap[i]] = vertices[i];
+			}
+			vertices.swap(reordered);
+		}
+
+		//Work out the bounds, squeeze the indices down to 16 bits if they fit, and point blobs at it all
+		void finish(){
+			blobs.bounds = MeshBounds::of(vertices.data(), vertices.size());
+			blobs.vertices = vertices.data();
+			blobs.vertexCount = vertices.size();
+			blobs.indexCount = indices.size();
+			if(vertices.size() <= 65536){
+				shortIndices.assign(indices.begin(), indices.end());
+				blobs.indices = shortIndices.data();
+				blobs.indexType = GL_UNSIGNED_SHORT;
+			} else {
+				blobs.indices = indices.data();
+				blobs.indexType = GL_UNSIGNED_INT;
+			}
+		}
+
+		bool loadCache(const std::string &path, size_t sourceSize, int64_t sourceModified){
+			if(!cacheFile.open(path.c_str())) return false;
+			CacheHeader header;
+			bool valid = cacheFile.size >= sizeof(header);
+			if(valid){
+				memcpy(&header, cacheFile.data, sizeof(header));
+				valid = memcmp(header.magic, "MSHC", 4) == 0 && header.version == CACHE_VERSION
+					&& header.vertexSize == sizeof(MeshVertex)
+					&& header.sourceSize == sourceSize && header.sourceModified == sourceModified
+					&& (header.indexType == GL_UNSIGNED_SHORT || header.indexType == GL_UNSIGNED_INT);
+			}
+			if(valid){
+				blobs.vertices = (const MeshVertex*)(cacheFile.data + sizeof(header));
+				blobs.vertexCount = header.vertexCount;
+				blobs.indices = cacheFile.data + sizeof(header) + (size_t)header.vertexCount * sizeof(MeshVertex);
+				blobs.indexCount = header.indexCount;
+				blobs.indexType = header.indexType;
+				blobs.bounds = header.bounds;
+				valid = cacheFile.size == sizeof(header) + (size_t)header.vertexCount * sizeof(MeshVertex) + blobs.indexBytes();
+			}
+			if(!valid){
+				//Stale or from an older build: we'll parse the source and write a new one
+				cacheFile.close();
+				memset(&blobs, 0, sizeof(blobs));
+			}
+			return valid;
+		}
+
+		void saveCache(const std::string &path, size_t sourceSize, int64_t sourceModified){
+			CacheHeader header;
+			memset(&header, 0, sizeof(header));
+			memcpy(header.magic, "MSHC", 4);
+			header.version = CACHE_VERSION;
+			header.sourceSize = sourceSize;
+			header.sourceModified = sourceModified;
+			header.vertexCount = blobs.vertexCount;
+			header.indexCount = blobs.indexCount;
+			header.vertexSize = sizeof(MeshVertex);
+			header.indexType = blobs.indexType;
+			header.bounds = blobs.bounds;
+
+			//Write to a temporary file and rename it into place, so nobody
+			//ever maps a half-written cache.
+			std::string tempPath = path + ".tmp";
+			std::ofstream file(tempPath, std::ios::binary);
+			file.write((const char*)&header, sizeof(header));
+			file.write((const char*)blobs.vertices, (size_t)blobs.vertexCount * sizeof(MeshVertex));
+			file.write((const char*)blobs.indices, blobs.indexBytes());
+			file.close();
+			if(!file || rename(tempPath.c_str(), path.c_str()) != 0){
+				std::cout << "WARNING: Couldn't write mesh cache " << path << std::endl;
+				remove(tempPath.c_str());
+			}
+		}
+};
+
+#endif
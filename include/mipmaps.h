@@ -0,0 +1,134 @@
+#ifndef MIPMAPS_H
+#define MIPMAPS_H
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+//One downsampled level of an image. Level 0 is the image itself.
+struct MipLevel{
+	int width;
+	int height;
+	std::vector<unsigned char> data;
+};
+
+//Builds a full mip chain on the CPU with a 2x2 box filter, so it can run on the
+//decode threads instead of leaving glGenerateMipmap to do it (slowly, per level,
+//on the render thread) in software drivers.
+//8-bit RGBA, which is what nearly everything decodes to, gets SSE2/AVX2 kernels on x86.
+//Everything else takes the plain C++ path.
+class MipGenerator{
+	public:
+		//Returns levels 1 and up for a tightly packed image. Each level is half the size of
+		//the one before, rounding down, until we get to 1x1. Same as GL, so the chain lines
+		//up with what glTexStorage2D expects.
+		static std::vector<MipLevel> generate(const unsigned char* pixels, int width, int height, int channels, int bytesPerChannel){
+			std::vector<MipLevel> mips;
+			const unsigned char* source = pixels;
+			while(width > 1 || height > 1){
+				MipLevel level;
+				level.width = std::max(1, width / 2);
+				level.height = std::max(1, height / 2);
+				level.data.resize((size_t)level.width * level.height * channels * bytesPerChannel);
+				if(bytesPerChannel == 2){
+					downsample((const uint16_t*)source, width, height, channels, (uint16_t*)level.data.data(), level.width, level.height);
+				} else {
+					downsample(source, width, height, channels, level.data.data(), level.width, level.height);
+				}
+				mips.push_back(std::move(level));
+				source = mips.back().data.data();
+				width = mips.back().width;
+				height = mips.back().height;
+			}
+			return mips;
+		}
+
+	private:
+		//One level down. Odd rows and columns at the far edge get dropped, like GL's own box filter.
+		template<typename T>
+		static void downsample(const T* source, int width, int height, int channels, T* dest, int destWidth, int destHeight){
+			size_t rowLength = (size_t)width * channels;
+			for(int y = 0; y < destHeight; y++){
+				//If the source is only one pixel tall (or wide), average it with itself
+				const T* rowA = source + (size_t)std::min(2 * y, height - 1) * rowLength;
+				const T* rowB = source + (size_t)std::min(2 * y + 1, height - 1) * rowLength;
+				T* out = dest + (size_t)y * destWidth * channels;
+				int x = 0;
+#if defined(__SSE2__)
+				if(sizeof(T) == 1 && channels == 4 && width > 1){
+					x = downsampleRowRGBA8((const uint8_t*)rowA, (const uint8_t*)rowB, (uint8_t*)out, destWidth);
+				}
+#endif
+				for(; x < destWidth; x++){
+					int x0 = std::min(2 * x, width - 1) * channels;
+					int x1 = std::min(2 * x + 1, width - 1) * channels;
+					for(int c = 0; c < channels; c++){
+						unsigned int sum = rowA[x0 + c] + rowA[x1 + c] + rowB[x0 + c] + rowB[x1 + c];
+						out[x * channels + c] = (T)((sum + 2) / 4);
+					}
+				}
+			}
+		}
+
+#if defined(__SSE2__)
+		//Does as much of a row as the SIMD kernels can, returns how many output pixels it did
+		static int downsampleRowRGBA8(const uint8_t* rowA, const uint8_t* rowB, uint8_t* out, int destWidth){
+			static const bool hasAVX2 = __builtin_cpu_supports("avx2");
+			int x = 0;
+			if(hasAVX2){
+				x = downsampleRowAVX2(rowA, rowB, out, destWidth);
+			}
+			return downsampleRowSSE2(rowA, rowB, out, destWidth, x);
+		}
+
+		//2 output pixels per step: 4 input pixels from each of the two rows
+		static int downsampleRowSSE2(const uint8_t* rowA, const uint8_t* rowB, uint8_t* out, int destWidth, int x){
+			const __m128i zero = _mm_setzero_si128();
+			const __m128i rounding = _mm_set1_epi16(2);
+			for(; x + 2 <= destWidth; x += 2){
+				__m128i a = _mm_loadu_si128((const __m128i*)(rowA + x * 8));
+				__m128i b = _mm_loadu_si128((const __m128i*)(rowB + x * 8));
+				//Widen to 16 bits so the sums can't overflow, and add the two rows together
+				__m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero)); //Pixels 0, 1
+				__m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero)); //Pixels 2, 3
+				//Then add each pixel to its right-hand neighbour
+				lo = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+				hi = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+				__m128i sum = _mm_unpacklo_epi64(lo, hi);
+				sum = _mm_srli_epi16(_mm_add_epi16(sum, rounding), 2);
+				_mm_storel_epi64((__m128i*)(out + x * 4), _mm_packus_epi16(sum, sum));
+			}
+			return x;
+		}
+
+		//Same thing 4 output pixels at a time. AVX2 shuffles stay within 128-bit lanes,
+		//so each lane does 2 pixels and we stitch them back together at the end.
+		__attribute__((target("avx2")))
+		static int downsampleRowAVX2(const uint8_t* rowA, const uint8_t* rowB, uint8_t* out, int destWidth){
+			const __m256i zero = _mm256_setzero_si256();
+			const __m256i rounding = _mm256_set1_epi16(2);
+			int x = 0;
+			for(; x + 4 <= destWidth; x += 4){
+				__m256i a = _mm256_loadu_si256((const __m256i*)(rowA + x * 8));
+				__m256i b = _mm256_loadu_si256((const __m256i*)(rowB + x * 8));
+				__m256i lo = _mm256_add_epi16(_mm256_unpacklo_epi8(a, zero), _mm256_unpacklo_epi8(b, zero));
+				__m256i hi = _mm256_add_epi16(_mm256_unpackhi_epi8(a, zero), _mm256_unpackhi_epi8(b, zero));
+				lo = _mm256_add_epi16(lo, _mm256_srli_si256(lo, 8));
+				hi = _mm256_add_epi16(hi, _mm256_srli_si256(hi, 8));
+				__m256i sum = _mm256_unpacklo_epi64(lo, hi);
+				sum = _mm256_srli_epi16(_mm256_add_epi16(sum, rounding), 2);
+				__m256i packed = _mm256_packus_epi16(sum, sum);
+				//Results are in the low 8 bytes of each lane; pull them next to each other
+				packed = _mm256_permute4x64_epi64(packed, 0x08);
+				_mm_storeu_si128((__m128i*)(out + x * 4), _mm256_castsi256_si128(packed));
+			}
+			return x;
+		}
+#endif
+};
+
+#endif
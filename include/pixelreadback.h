@@ -0,0 +1,96 @@
+#ifndef PIXELREADBACK_H
+#define PIXELREADBACK_H
+
+#include <epoxy/gl.h>
+#include <epoxy/glx.h>
+
+#include <cstddef>
+#include <iostream>
+
+//Reads pixels back from the GPU without stalling on them. start() has glReadPixels copy
+//into a pixel buffer object, which the GPU does whenever it gets round to it, and drops a
+//fence after it. ready() says whether that's happened yet. map() gets at the pixels,
+//waiting only if they still aren't there.
+//
+//Pixels come back RGBA8, bottom row first, with rows packed tight (width * 4 bytes).
+class PixelReadback{
+	public:
+		unsigned int PBO;
+		int width;
+		int height;
+
+		PixelReadback() : width(0), height(0), fence(0), size(0), mapped(NULL){
+			glGenBuffers(1, &PBO);
+		}
+
+		~PixelReadback(){
+			if(mapped) unmap();
+			if(fence) glDeleteSync(fence);
+			glDeleteBuffers(1, &PBO);
+		}
+
+		PixelReadback(const PixelReadback&) = delete;
+		PixelReadback& operator=(const PixelReadback&) = delete;
+
+		//Queues up a copy of part of whatever's bound for reading. Returns straight away.
+		void start(int x, int y, int readWidth, int readHeight){
+			if(mapped) unmap();
+			if(fence) glDeleteSync(fence);
+			width = readWidth;
+			height = readHeight;
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, PBO);
+			size_t bytes = (size_t)width * height * 4;
+			if(bytes != size){
+				glBufferData(GL_PIXEL_PACK_BUFFER, bytes, NULL, GL_STREAM_READ);
+				size = bytes;
+			}
+			glPixelStorei(GL_PACK_ALIGNMENT, 4);
+			glReadPixels(x, y, width, height, GL_RGBA, GL_UNSIGNED_BYTE, (void*)0);
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+			fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		}
+
+		//Whether the copy has landed, so map() won't wait. Never blocks.
+		bool ready(){
+			if(!fence) return false;
+			GLenum status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+			return status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED;
+		}
+
+		//The pixels, width * height * 4 bytes of them, valid until unmap() or the next start().
+		//NULL if nothing was started.
+		const unsigned char* map(){
+			if(!fence) return mapped;
+			GLenum status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+			while(status == GL_TIMEOUT_EXPIRED){
+				status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+			}
+			if(status == GL_WAIT_FAILED){
+				std::cout << "ERROR: Waiting on a pixel readback fence failed" << std::endl;
+			}
+			glDeleteSync(fence);
+			fence = 0;
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, PBO);
+			mapped = (const unsigned char*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+			if(!mapped){
+				std::cout << "ERROR: Couldn't map the pixel readback buffer" << std::endl;
+			}
+			return mapped;
+		}
+
+		void unmap(){
+			if(!mapped) return;
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, PBO);
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+			mapped = NULL;
+		}
+
+	private:
+		GLsync fence; //Set from start() until map()
+		size_t size; //Of the buffer's storage, in bytes
+		const unsigned char* mapped;
+};
+
+#endif
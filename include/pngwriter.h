@@ -0,0 +1,104 @@
+#ifndef PNGWRITER_H
+#define PNGWRITER_H
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+//Writes 8-bit RGB or RGBA PNGs, using zlib for the compression (stb_image only reads).
+//Rows get no PNG filtering, which costs a little file size but keeps it fast; the
+//compression level is up to the caller, from 1 (fast) to 9 (small).
+class PNGWriter{
+	public:
+		//pixels: width * height pixels of channels bytes each (3 or 4), rows rowBytes apart.
+		//bottomUp: the first row in memory is the bottom of the picture, like GL gives it us.
+		//dropAlpha: write 4 channel data out as RGB.
+		static bool write(const std::string &path, const unsigned char* pixels, int width, int height,
+				int channels, size_t rowBytes, bool bottomUp, bool dropAlpha = false, int level = 6){
+			std::vector<unsigned char> png = encode(pixels, width, height, channels, rowBytes, bottomUp, dropAlpha, level);
+			if(png.empty()) return false;
+			FILE* file = fopen(path.c_str(), "wb");
+			if(!file){
+				std::cout << "ERROR: Couldn't open " << path << " for writing" << std::endl;
+				return false;
+			}
+			bool written = fwrite(png.data(), 1, png.size(), file) == png.size();
+			written = fclose(file) == 0 && written;
+			if(!written){
+				std::cout << "ERROR: Couldn't write " << path << std::endl;
+			}
+			return written;
+		}
+
+		//The whole file, in memory. Empty if zlib failed.
+		static std::vector<unsigned char> encode(const unsigned char* pixels, int width, int height,
+				int channels, size_t rowBytes, bool bottomUp, bool dropAlpha = false, int level = 6){
+			int outChannels = dropAlpha ? 3 : channels;
+			//Each row is a filter type byte (0, none) then the pixels
+			size_t outRowBytes = (size_t)width * outChannels;
+			std::vector<unsigned char> raw((outRowBytes + 1) * height);
+			for(int y = 0; y < height; y++){
+				const unsigned char* row = pixels + (size_t)(bottomUp ? height - 1 - y : y) * rowBytes;
+				unsigned char* out = &raw[(outRowBytes + 1) * y];
+				*out++ = 0;
+				if(outChannels == channels){
+					std::copy(row, row + outRowBytes, out);
+				} else {
+					for(int x = 0; x < width; x++){
+						out[x * 3] = row[x * channels];
+						out[x * 3 + 1] = row[x * channels + 1];
+						out[x * 3 + 2] = row[x * channels + 2];
+					}
+				}
+			}
+			uLongf compressedSize = compressBound(raw.size());
+			std::vector<unsigned char> compressed(compressedSize);
+			if(compress2(compressed.data(), &compressedSize, raw.data(), raw.size(), level) != Z_OK){
+				std::cout << "ERROR: zlib couldn't compress a PNG" << std::endl;
+				return std::vector<unsigned char>();
+			}
+			compressed.resize(compressedSize);
+
+			std::vector<unsigned char> png = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+			unsigned char header[13];
+			putBigEndian(header, width);
+			putBigEndian(header + 4, height);
+			header[8] = 8; //Bits per channel
+			header[9] = outChannels == 4 ? 6 : 2; //RGBA or RGB
+			header[10] = 0; //Deflate
+			header[11] = 0; //Adaptive filtering (each row says which filter it used)
+			header[12] = 0; //Not interlaced
+			addChunk(png, "IHDR", header, sizeof(header));
+			addChunk(png, "IDAT", compressed.data(), compressed.size());
+			addChunk(png, "IEND", NULL, 0);
+			return png;
+		}
+
+	private:
+		static void putBigEndian(unsigned char* out, uint32_t value){
+			out[0] = value >> 24;
+			out[1] = value >> 16;
+			out[2] = value >> 8;
+			out[3] = value;
+		}
+
+		//Length, type, data, then a CRC of the type and data
+		static void addChunk(std::vector<unsigned char> &png, const char* type, const unsigned char* data, size_t size){
+			unsigned char word[4];
+			putBigEndian(word, size);
+			png.insert(png.end(), word, word + 4);
+			size_t typeAt = png.size();
+			png.insert(png.end(), type, type + 4);
+			if(size > 0) png.insert(png.end(), data, data + size);
+			uLong crc = crc32(0L, &png[typeAt], size + 4);
+			putBigEndian(word, crc);
+			png.insert(png.end(), word, word + 4);
+		}
+};
+
+#endif
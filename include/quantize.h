@@ -0,0 +1,88 @@
+#ifndef QUANTIZE_H
+#define QUANTIZE_H
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+//Helpers for squeezing vertex data into fewer bits. Positions become 16-bit unsigned
+//normalized values across the mesh's bounding box, texture coordinates become half
+//floats (they can go past 0-1 when a texture repeats), and normals become signed bytes.
+//GL turns normalized integers back into 0-1 (or -1-1) floats on the way into the shader,
+//and the vertex shader stretches positions back out with positionScale and positionOffset.
+class VertexQuantizer{
+	public:
+		//How to get from 0-1 back to the box from min to max: offset + value * scale
+		struct Dequantization{
+			glm::vec3 scale;
+			glm::vec3 offset;
+		};
+
+		static Dequantization dequantization(const float min[3], const float max[3]){
+			Dequantization result;
+			for(int axis = 0; axis < 3; axis++){
+				float extent = max[axis] - min[axis];
+				result.scale[axis] = extent > 0.0f ? extent : 1.0f; //Flat along this axis: anything will do
+				result.offset[axis] = min[axis];
+			}
+			return result;
+		}
+
+		//For float data that doesn't need stretching back out
+		static Dequantization identity(){
+			Dequantization result;
+			result.scale = glm::vec3(1.0f);
+			result.offset = glm::vec3(0.0f);
+			return result;
+		}
+
+		//0-1 across the box, rounded to the nearest of 65536 steps
+		static void position(const float in[3], const Dequantization &box, uint16_t out[3]){
+			for(int axis = 0; axis < 3; axis++){
+				float t = (in[axis] - box.offset[axis]) / box.scale[axis];
+				out[axis] = (uint16_t)(clamp(t, 0.0f, 1.0f) * 65535.0f + 0.5f);
+			}
+		}
+
+		static int8_t snorm8(float value){
+			return (int8_t)std::lround(clamp(value, -1.0f, 1.0f) * 127.0f);
+		}
+
+		//IEEE half float, rounded to nearest even. Too big becomes infinity, too small becomes zero.
+		static uint16_t half(float value){
+			uint32_t bits;
+			memcpy(&bits, &value, sizeof(bits));
+			uint16_t sign = (bits >> 16) & 0x8000;
+			int exponent = (int)((bits >> 23) & 0xff) - 127 + 15;
+			uint32_t mantissa = bits & 0x7fffff;
+			if(((bits >> 23) & 0xff) == 0xff){
+				return sign | 0x7c00 | (mantissa ? 0x200 : 0); //Infinity or NaN
+			}
+			if(exponent >= 31) return sign | 0x7c00;
+			if(exponent <= 0){
+				//Subnormal half, or zero if it's too small even for that
+				if(exponent < -10) return sign;
+				mantissa |= 0x800000;
+				int shift = 14 - exponent;
+				uint32_t rounded = mantissa >> shift;
+				uint32_t remainder = mantissa & ((1u << shift) - 1);
+				uint32_t halfway = 1u << (shift - 1);
+				if(remainder > halfway || (remainder == halfway && (rounded & 1))) rounded++;
+				return sign | rounded;
+			}
+			uint32_t result = (exponent << 10) | (mantissa >> 13);
+			uint32_t remainder = mantissa & 0x1fff;
+			//Rounding up can carry into the exponent, which is exactly what should happen
+			if(remainder > 0x1000 || (remainder == 0x1000 && (result & 1))) result++;
+			return sign | result;
+		}
+
+	private:
+		static float clamp(float value, float low, float high){
+			return value < low ? low : (value > high ? high : value);
+		}
+};
+
+#endif
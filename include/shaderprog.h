@@ -4,7 +4,14 @@
 #include <epoxy/gl.h>
 #include <epoxy/glx.h>
 
+#include <sys/stat.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <string>
+#include <utility>
+#include <vector>
 #include <fstream>
 #include <sstream>
 #include <iostream>
@@ -15,10 +22,134 @@ class ShaderProg{
 	public:
 		unsigned int ID;
 
-		ShaderProg(const char* vertexPath, const char* fragmentPath){
+		//Linked program binaries get cached in cacheDir, keyed by the shader source
+		//and the driver. Pass NULL to always compile from source.
+		ShaderProg(const char* vertexPath, const char* fragmentPath, const char* cacheDir = "shader_cache")
+			: vertexPath(vertexPath), fragmentPath(fragmentPath), cacheDir(cacheDir ? cacheDir : ""){
 			// First: Read the shader code from the files
 			std::string vertexCode;
 			std::string fragmentCode;
+			readSources(vertexCode, fragmentCode);
+
+			bool linked;
+			ID = build(vertexCode, fragmentCode, linked);
+			cacheUniforms();
+		}
+
+		//Reads the shader files again and builds them into a new program. That only replaces
+		//the current one if it links; if it doesn't, the errors get printed and we carry on
+		//with the old program. Returns true if it was replaced, in which case everything
+		//set on the old one (uniforms, block bindings, locations from uniform()) needs doing again.
+		bool reload(){
+			std::string vertexCode;
+			std::string fragmentCode;
+			if(!readSources(vertexCode, fragmentCode)) return false;
+			bool linked;
+			unsigned int program = build(vertexCode, fragmentCode, linked);
+			if(!linked){
+				glDeleteProgram(program);
+				std::cout << "Shader reload failed, still using the last program that worked" << std::endl;
+				return false;
+			}
+			glDeleteProgram(ID); //(GL holds off deleting it while it's in use)
+			ID = program;
+			cacheUniforms();
+			std::cout << "Reloaded " << vertexPath << " and " << fragmentPath << std::endl;
+			return true;
+		}
+
+		const std::string &vertexFile() const{ return vertexPath; }
+		const std::string &fragmentFile() const{ return fragmentPath; }
+
+		//FNV-1a string hash. It's constexpr so names that are known up front
+		//can be hashed at compile time, e.g. ShaderProg::hashName("viewMatrix").
+		static constexpr uint32_t hashName(const char* name, uint32_t hash = 2166136261u){
+			return *name ? hashName(name + 1, (hash ^ (uint8_t)*name) * 16777619u) : hash;
+		}
+
+		//64-bit FNV-1a over a run of bytes, chained through hash so several
+		//strings can be folded into one key.
+		static uint64_t hashBytes(const void* data, size_t length, uint64_t hash = 14695981039346656037ull){
+			const uint8_t* bytes = (const uint8_t*)data;
+			for(size_t i = 0; i < length; i++){
+				hash = (hash ^ bytes[i]) * 1099511628211ull;
+			}
+			return hash;
+		}
+
+		//Look up a uniform's location from our cache. Like glGetUniformLocation,
+		//returns -1 if the program has no such (active) uniform.
+		//Do this once outside the render loop and hold on to the result.
+		int uniform(const char* name) const{
+			if(uniformSlots.empty()) return -1;
+			uint32_t nameHash = hashName(name);
+			size_t mask = uniformSlots.size() - 1;
+			//(The table's never more than half full, so this always finds an empty slot)
+			for(size_t i = nameHash & mask, probes = 0; probes < uniformSlots.size(); i = (i + 1) & mask, probes++){
+				const UniformSlot& slot = uniformSlots[i];
+				if(slot.location == -1) return -1; //Hit an empty slot, so it's not here
+				//Different names can share a hash, so check it really is this one
+				if(slot.hash == nameHash && slot.name == name) return slot.location;
+			}
+			return -1;
+		}
+		int uniform(const std::string &name) const{
+			return uniform(name.c_str());
+		}
+
+		//Point a uniform block in this program at a buffer binding point.
+		//(GLSL 330 can't say layout(binding = N) itself.)
+		void bindUniformBlock(const char* blockName, unsigned int binding){
+			unsigned int index = glGetUniformBlockIndex(ID, blockName);
+			if(index != GL_INVALID_INDEX){
+				glUniformBlockBinding(ID, index, binding);
+			}
+		}
+
+		void use(){
+			glUseProgram(ID);
+		}
+
+		void setBool(const std::string &name, bool value) const{
+			setBool(uniform(name), value);
+		}
+		void setInt(const std::string &name, int value) const{
+			setInt(uniform(name), value);
+		}
+		void setFloat(const std::string &name, float value) const{
+			setFloat(uniform(name), value);
+		}
+		void setVec3(const std::string &name, const glm::vec3 &value) const{
+			setVec3(uniform(name), value);
+		}
+		void setMat4(const std::string &name, glm::mat4 value) const{
+			setMat4(uniform(name), value);
+		}
+
+		//Handle-based versions, for use with a location from uniform().
+		//These never touch strings, so they're the ones to use in the render loop.
+		void setBool(int location, bool value) const{
+			glUniform1i(location, (int)value);
+		}
+		void setInt(int location, int value) const{
+			glUniform1i(location, value);
+		}
+		void setFloat(int location, float value) const{
+			glUniform1f(location, value);
+		}
+		void setVec3(int location, const glm::vec3 &value) const{
+			glUniform3fv(location, 1, glm::value_ptr(value));
+		}
+		void setMat4(int location, const glm::mat4 &value) const{
+			glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(value));
+		}
+
+	private:
+		std::string vertexPath;
+		std::string fragmentPath;
+		std::string cacheDir; //Empty for no binary cache
+
+		bool readSources(std::string &vertexCode, std::string &fragmentCode){
 			std::ifstream vShaderFile;
 			std::ifstream fShaderFile;
 
@@ -40,66 +171,263 @@ class ShaderProg{
 				fragmentCode = fShaderStream.str();
 			} catch(std::ifstream::failure& e){
 				std::cout << "ERROR: Reading shader files failed:\n" << e.what() << std::endl;
+				return false;
 			}
+			return true;
+		}
 
-			const char* vShaderCode = vertexCode.c_str();
-			const char* fShaderCode = fragmentCode.c_str();
+		//Makes a program out of the two sources, from the binary cache if it can.
+		//linked says whether it worked; the program's returned either way.
+		unsigned int build(const std::string &vertexCode, const std::string &fragmentCode, bool &linked){
+			//If we've linked this exact program on this exact driver before,
+			//we can skip compilation entirely and load the binary from disk.
+			std::string cachePath;
+			unsigned int program;
+			if(!cacheDir.empty() && programBinarySupported()){
+				cachePath = binaryCachePath(cacheDir.c_str(), vertexCode, fragmentCode);
+				if(loadBinary(cachePath, program)){
+					linked = true;
+					return program;
+				}
+			}
 
 			// Compile shaders
-			unsigned int vertex, fragment;
-			int success = 1;
-			char infoLog[512];
+			unsigned int vertex = compile(GL_VERTEX_SHADER, vertexCode, vertexPath, "Vertex");
+			unsigned int fragment = compile(GL_FRAGMENT_SHADER, fragmentCode, fragmentPath, "Fragment");
 
-			vertex = glCreateShader(GL_VERTEX_SHADER);
-			glShaderSource(vertex, 1, &vShaderCode, NULL);
-			glCompileShader(vertex);
-			glGetShaderiv(ID, GL_COMPILE_STATUS, &success);
+			// Link shaders
+			program = glCreateProgram();
+			glAttachShader(program, vertex);
+			glAttachShader(program, fragment);
+			if(!cachePath.empty()){
+				//Ask the driver to keep the linked binary around so we can save it
+				glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+			}
+			glLinkProgram(program);
+			int success = 0;
+			glGetProgramiv(program, GL_LINK_STATUS, &success);
+			linked = success;
 			if(!success){
-				glGetShaderInfoLog(ID, 512, NULL, infoLog);
-				std::cout << "ERROR: Vertex shader compilation failed:\n" << infoLog << std::endl;
+				std::cout << "ERROR: Shader program linkage failed:\n" << infoLog(program, false) << std::endl;
+			} else if(!cachePath.empty()){
+				saveBinary(cachePath, program);
 			}
 
-			fragment = glCreateShader(GL_FRAGMENT_SHADER);
-			glShaderSource(fragment, 1, &fShaderCode, NULL);
-			glCompileShader(fragment);
-			glGetShaderiv(ID, GL_COMPILE_STATUS, &success);
+			//Clean up the no-longer-needed shader data.
+			glDeleteShader(vertex);
+			glDeleteShader(fragment);
+			return program;
+		}
+
+		static unsigned int compile(GLenum type, const std::string &code, const std::string &path, const char* stage){
+			const char* source = code.c_str();
+			unsigned int shader = glCreateShader(type);
+			glShaderSource(shader, 1, &source, NULL);
+			glCompileShader(shader);
+			int success = 1;
+			glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
 			if(!success){
-				glGetShaderInfoLog(ID, 512, NULL, infoLog);
-				std::cout << "ERROR: Fragment shader compilation failed:\n" << infoLog << std::endl;
+				std::cout << "ERROR: " << stage << " shader compilation failed:\n" << withFileName(infoLog(shader, true), path) << std::endl;
 			}
+			return shader;
+		}
 
-			// Link shaders
-			ID = glCreateProgram();
-			glAttachShader(ID, vertex);
-			glAttachShader(ID, fragment);
-			glLinkProgram(ID);
-			glGetProgramiv(ID, GL_LINK_STATUS, &success);
-			if(!success){
-				glGetProgramInfoLog(ID, 512, NULL, infoLog);
-				std::cout << "ERROR: Shader program linkage failed:\n" << infoLog << std::endl;
+		//All of a shader's or program's log, however long
+		static std::string infoLog(unsigned int object, bool shader){
+			int length = 0;
+			if(shader) glGetShaderiv(object, GL_INFO_LOG_LENGTH, &length);
+			else glGetProgramiv(object, GL_INFO_LOG_LENGTH, &length);
+			if(length <= 1) return std::string();
+			std::vector<char> log(length);
+			if(shader) glGetShaderInfoLog(object, length, NULL, log.data());
+			else glGetProgramInfoLog(object, length, NULL, log.data());
+			return std::string(log.data());
+		}
+
+		//Drivers say where an error is as "0:12(5): error: ..." (Mesa), "0(12) : error ..."
+		//(NVIDIA) or "ERROR: 0:12: ..." (AMD and most others), the 0 being which source string.
+		//We only ever pass the one, so swap it for the file name, giving "vertex.glsl:12:5: error: ..."
+		//like any other compiler (and that editors know how to jump to).
+		static std::string withFileName(const std::string &log, const std::string &path){
+			std::istringstream lines(log);
+			std::string line, result;
+			while(std::getline(lines, line)){
+				const char* text = line.c_str();
+				std::string severity;
+				for(const char* prefix : {"ERROR: ", "WARNING: "}){
+					if(strncmp(text, prefix, strlen(prefix)) == 0){
+						severity = prefix;
+						text += strlen(prefix);
+					}
+				}
+				int source, lineNumber, column = 0, used = 0;
+				if(sscanf(text, "%d:%d(%d)%n", &source, &lineNumber, &column, &used) < 3 || used == 0){
+					column = 0;
+					used = 0;
+					if(sscanf(text, "%d(%d)%n", &source, &lineNumber, &used) < 2 || used == 0){
+						used = 0;
+						sscanf(text, "%d:%d%n", &source, &lineNumber, &used);
+					}
+				}
+				if(used == 0){
+					result += line + "\n";
+					continue;
+				}
+				text += used;
+				while(*text == ' ' || *text == ':') text++;
+				result += path + ":" + std::to_string(lineNumber) + (column > 0 ? ":" + std::to_string(column) : "") + ": " + severity + text + "\n";
 			}
+			return result;
+		}
 
-			//Clean up the no-longer-needed shader data.
-			glDeleteShader(vertex);
-			glDeleteShader(fragment);
+		//What goes at the front of a cached program binary file
+		struct BinaryHeader{
+			char magic[4];
+			uint32_t format; //Driver-specific binary format enum from glGetProgramBinary
+			uint32_t length;
+			uint64_t key; //Guards against a hash-named file that doesn't match what we expected
+		};
+		uint64_t binaryKey;
 
+		static bool programBinarySupported(){
+			if(epoxy_gl_version() < 41 && !epoxy_has_gl_extension("GL_ARB_get_program_binary")){
+				return false;
+			}
+			int formatCount = 0;
+			glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+			return formatCount > 0;
 		}
 
-		void use(){
-			glUseProgram(ID);
+		//Binaries are only good for the driver that made them, so the driver's
+		//vendor, renderer and version strings go into the key along with the source.
+		std::string binaryCachePath(const char* cacheDir, const std::string &vertexCode, const std::string &fragmentCode){
+			const char* driverStrings[] = {
+				(const char*)glGetString(GL_VENDOR),
+				(const char*)glGetString(GL_RENDERER),
+				(const char*)glGetString(GL_VERSION)
+			};
+			uint64_t key = hashBytes(vertexCode.c_str(), vertexCode.size() + 1); //Include the terminator so the two sources can't run together
+			key = hashBytes(fragmentCode.c_str(), fragmentCode.size() + 1, key);
+			for(const char* driverString : driverStrings){
+				if(driverString) key = hashBytes(driverString, strlen(driverString) + 1, key);
+			}
+			binaryKey = key;
+
+			mkdir(cacheDir, 0755); //Fine if it's already there
+			char fileName[32];
+			snprintf(fileName, sizeof(fileName), "/%016llx.bin", (unsigned long long)key);
+			return std::string(cacheDir) + fileName;
 		}
 
-		void setBool(const std::string &name, bool value) const{
-			glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+		//Returns false if there's no usable cached binary, in which case we'll have to compile
+		bool loadBinary(const std::string &path, unsigned int &program){
+			std::ifstream file(path, std::ios::binary);
+			if(!file) return false;
+
+			BinaryHeader header;
+			file.read((char*)&header, sizeof(header));
+			if(!file || memcmp(header.magic, "SPBC", 4) != 0 || header.key != binaryKey){
+				return false;
+			}
+			std::vector<char> binary(header.length);
+			file.read(binary.data(), binary.size());
+			if(!file) return false;
+
+			program = glCreateProgram();
+			glProgramBinary(program, header.format, binary.data(), header.length);
+			int success = 0;
+			glGetProgramiv(program, GL_LINK_STATUS, &success);
+			if(!success){
+				//Drivers are allowed to reject binaries at any time (after an update, say).
+				//Not an error, we just have to compile from source this time.
+				std::cout << "Cached shader binary " << path << " was rejected, recompiling" << std::endl;
+				glDeleteProgram(program);
+				return false;
+			}
+			return true;
 		}
-		void setInt(const std::string &name, int value) const{
-			glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+
+		void saveBinary(const std::string &path, unsigned int program){
+			int length = 0;
+			glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+			if(length <= 0) return;
+
+			BinaryHeader header;
+			memset(&header, 0, sizeof(header)); //Padding too, so the same program always makes the same file
+			memcpy(header.magic, "SPBC", 4);
+			header.key = binaryKey;
+			std::vector<char> binary(length);
+			GLenum format;
+			glGetProgramBinary(program, length, NULL, &format, binary.data());
+			header.format = format;
+			header.length = length;
+
+			//Write to a temporary file and rename it into place, so nobody
+			//ever sees a half-written binary.
+			std::string tempPath = path + ".tmp";
+			std::ofstream file(tempPath, std::ios::binary);
+			file.write((const char*)&header, sizeof(header));
+			file.write(binary.data(), binary.size());
+			file.close();
+			if(!file || rename(tempPath.c_str(), path.c_str()) != 0){
+				std::cout << "WARNING: Couldn't write shader binary cache " << path << std::endl;
+				remove(tempPath.c_str());
+			}
 		}
-		void setFloat(const std::string &name, float value) const{
-			glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+
+		struct UniformSlot{
+			uint32_t hash;
+			int location; //-1 marks an empty slot
+			std::string name;
+		};
+		//Open-addressed hash table, sized to a power of two so we can mask instead of mod.
+		std::vector<UniformSlot> uniformSlots;
+
+		//Ask the driver for every active uniform once, right after linking,
+		//so we never have to call glGetUniformLocation again.
+		void cacheUniforms(){
+			int uniformCount = 0;
+			glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &uniformCount);
+
+			//Gather the names first, so the table can be sized for however many there end up being
+			std::vector<std::pair<std::string, int>> entries;
+			char name[256];
+			for(int i = 0; i < uniformCount; i++){
+				int size;
+				GLenum type;
+				glGetActiveUniform(ID, i, sizeof(name), NULL, &size, &type, name);
+				int location = glGetUniformLocation(ID, name);
+				if(location == -1) continue; //Lives in a uniform block, so it has no location of its own
+				entries.push_back(std::make_pair(std::string(name), location));
+				//Arrays are reported as "name[0]", but we want to find them by plain "name" too.
+				char* bracket = strchr(name, '[');
+				if(bracket){
+					*bracket = '\0';
+					entries.push_back(std::make_pair(std::string(name), location));
+				}
+			}
+
+			size_t capacity = 16;
+			while(capacity < entries.size() * 2) capacity *= 2; //Keep the table at most half full
+			uniformSlots.assign(capacity, UniformSlot{0, -1, std::string()});
+			for(const std::pair<std::string, int> &entry : entries){
+				insertUniform(entry.first, entry.second);
+			}
 		}
-		void setMat4(const std::string &name, glm::mat4 value) const{
-			glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, glm::value_ptr(value));
+
+		void insertUniform(const std::string &name, int location){
+			uint32_t nameHash = hashName(name.c_str());
+			size_t mask = uniformSlots.size() - 1;
+			for(size_t i = nameHash & mask; ; i = (i + 1) & mask){
+				UniformSlot& slot = uniformSlots[i];
+				if(slot.location == -1){
+					slot.hash = nameHash;
+					slot.location = location;
+					slot.name = name;
+					return;
+				}
+				if(slot.hash == nameHash && slot.name == name) return; //Already in
+			}
 		}
 };
 
@@ -0,0 +1,63 @@
+#ifndef SOFTPRESENTER_H
+#define SOFTPRESENTER_H
+
+#include <epoxy/gl.h>
+#include <epoxy/glx.h>
+
+#include "softrasterizer.h"
+
+//Gets a SoftRasterizer's picture onto whatever framebuffer is bound for drawing (the window,
+//or the offscreen Framebuffer in headless runs), so the rest of the program doesn't care
+//which backend drew it. That's one texture upload and a blit a frame.
+class SoftPresenter{
+	public:
+		unsigned int texture;
+		unsigned int FBO;
+		int width;
+		int height;
+
+		SoftPresenter(int width, int height) : width(width), height(height){
+			glGenTextures(1, &texture);
+			glBindTexture(GL_TEXTURE_2D, texture);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			glBindTexture(GL_TEXTURE_2D, 0);
+
+			//Keep whatever's bound for drawing bound
+			GLint drawFramebuffer;
+			glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &drawFramebuffer);
+			glGenFramebuffers(1, &FBO);
+			glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+			if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE){
+				std::cout << "ERROR: Software rasterizer framebuffer is incomplete" << std::endl;
+			}
+			glBindFramebuffer(GL_FRAMEBUFFER, drawFramebuffer);
+		}
+
+		~SoftPresenter(){
+			glDeleteFramebuffers(1, &FBO);
+			glDeleteTextures(1, &texture);
+		}
+
+		SoftPresenter(const SoftPresenter&) = delete;
+		SoftPresenter& operator=(const SoftPresenter&) = delete;
+
+		//Copies the rasterizer's color buffer over the whole of the bound draw framebuffer
+		void present(const SoftRasterizer &rasterizer, int targetWidth, int targetHeight){
+			glBindTexture(GL_TEXTURE_2D, texture);
+			glPixelStorei(GL_UNPACK_ROW_LENGTH, rasterizer.stride);
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, rasterizer.color.data());
+			glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+			glBindTexture(GL_TEXTURE_2D, 0);
+
+			GLint readFramebuffer;
+			glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &readFramebuffer);
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, FBO);
+			glBlitFramebuffer(0, 0, width, height, 0, 0, targetWidth, targetHeight, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, readFramebuffer);
+		}
+};
+
+#endif
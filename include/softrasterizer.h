@@ -0,0 +1,457 @@
+#ifndef SOFTRASTERIZER_H
+#define SOFTRASTERIZER_H
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "jobsystem.h"
+#include "meshdata.h"
+#include "softtexture.h"
+
+//Draws textured triangles on the CPU, for machines without a GPU where the only GL
+//around is a software one we can't tune. It runs the same pipeline as vertex.glsl and
+//fragment.glsl, as C++:
+//
+//  drawInstanced(): every instance's vertices go through viewProjection * model. Triangles
+//  entirely outside the view are dropped, ones crossing the near plane get clipped, and the
+//  rest are set up (edge functions, and planes for depth and perspective-correct texture
+//  coordinates) and put in a bin for every TILE_SIZE square tile their bounds touch.
+//  Instances are split across the job system, each chunk filling bins of its own.
+//
+//  finish(): each tile runs through its bins, in the order things were drawn, testing
+//  4 pixels at a time against the edge functions and depth buffer with SSE (one at a
+//  time without it) and sampling
+//  the texture for whatever passes. Tiles never share pixels, so they all go in parallel.
+//
+//The color buffer is RGBA8 with the bottom row first, the way glReadPixels/glTexImage2D
+//see it. There's no backface culling, and depth is tested with LESS, like the GL path.
+class SoftRasterizer{
+	public:
+		static const int TILE_SIZE = 64;
+
+		int width;
+		int height;
+		int stride; //Pixels from one row to the next: width rounded up to a multiple of 4
+		std::vector<uint32_t> color;
+		std::vector<float> depth;
+
+		SoftRasterizer(int width, int height, JobSystem* jobs = NULL)
+			: width(width), height(height), jobs(jobs), batchCount(0){
+			stride = (width + 3) & ~3;
+			color.resize((size_t)stride * height);
+			depth.resize((size_t)stride * height);
+			tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+			tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+		}
+
+		SoftRasterizer(const SoftRasterizer&) = delete;
+		SoftRasterizer& operator=(const SoftRasterizer&) = delete;
+
+		//Starts a new frame: clears color and depth (to 1.0) and forgets everything drawn
+		void clear(const glm::vec4 &clearColor){
+			uint32_t packed = pack(clearColor);
+			forEach(height, 16, [&](size_t begin, size_t end){
+				std::fill(color.begin() + begin * stride, color.begin() + end * stride, packed);
+				std::fill(depth.begin() + begin * stride, depth.begin() + end * stride, 1.0f);
+			});
+			batchCount = 0;
+		}
+
+		//Like glDrawElementsInstanced with our shaders: count copies of mesh, one per matrix.
+		//fragment.glsl mixes in none of texture1, so only texture0 is needed.
+		//Everything passed in has to stay alive until finish().
+		void drawInstanced(const MeshBlobs &mesh, const glm::mat4* instances, size_t count,
+				const glm::mat4 &viewProjection, const SoftTexture* texture0){
+			if(count == 0 || mesh.indexCount == 0) return;
+			size_t chunks = std::min(count, (size_t)(jobs ? jobs->threadCount() * 4 : 1));
+			size_t first = batchCount;
+			batchCount += chunks;
+			if(batches.size() < batchCount) batches.resize(batchCount);
+			forEach(chunks, 1, [&](size_t begin, size_t end){
+				for(size_t chunk = begin; chunk < end; chunk++){
+					Batch &batch = batches[first + chunk];
+					batch.reset(tilesX * tilesY);
+					batch.texture = texture0;
+					size_t instanceBegin = count * chunk / chunks;
+					size_t instanceEnd = count * (chunk + 1) / chunks;
+					for(size_t i = instanceBegin; i < instanceEnd; i++){
+						drawInstance(batch, mesh, viewProjection * instances[i]);
+					}
+				}
+			});
+		}
+
+		//Rasterizes everything drawn since clear()
+		void finish(){
+			forEach(tilesX * tilesY, 1, [&](size_t begin, size_t end){
+				TileState state;
+				for(size_t tile = begin; tile < end; tile++){
+					state.x = (tile % tilesX) * TILE_SIZE;
+					state.y = (tile / tilesX) * TILE_SIZE;
+					state.x1 = std::min(state.x + TILE_SIZE, width);
+					state.y1 = std::min(state.y + TILE_SIZE, height);
+					state.triangles.clear();
+					std::fill(state.ids, state.ids + TILE_SIZE * TILE_SIZE, NO_TRIANGLE);
+					for(size_t b = 0; b < batchCount; b++){
+						const Batch &batch = batches[b];
+						for(uint32_t triangle : batch.bins[tile]){
+							state.triangles.push_back(TileTriangle{&batch.triangles[triangle], batch.texture});
+							rasterize(state, state.triangles.size() - 1);
+						}
+					}
+					shade(state);
+				}
+			});
+		}
+
+	private:
+		//Just what clipping needs to carry along
+		struct ClipVertex{
+			glm::vec4 position;
+			glm::vec2 texCoord;
+		};
+
+		//A triangle ready to rasterize. Edge functions are A*x + B*y + C, positive inside.
+		//Planes give depth, 1/w, u/w and v/w at any pixel as dx*x + dy*y + c.
+		struct SetupTriangle{
+			float edgeA[3], edgeB[3], edgeC[3];
+			uint32_t topLeft[3]; //All ones if pixels exactly on the edge count as inside
+			int minX, minY, maxX, maxY;
+			float planeDX[4], planeDY[4], planeC[4];
+		};
+
+		//What one job made out of its share of a draw
+		struct Batch{
+			const SoftTexture* texture;
+			std::vector<SetupTriangle> triangles;
+			std::vector<std::vector<uint32_t>> bins; //Indices into triangles, per tile
+			std::vector<glm::vec4> clip; //Scratch: one instance's vertices in clip space
+
+			void reset(size_t tileCount){
+				triangles.clear();
+				bins.resize(tileCount);
+				for(std::vector<uint32_t> &bin : bins){
+					bin.clear();
+				}
+			}
+		};
+
+		//What a tile's been covered with so far. Pixels only get shaded once every triangle
+		//in the tile has been depth tested, so each one's texture gets sampled just the once
+		//however many triangles were drawn over it.
+		static const uint32_t NO_TRIANGLE = 0xffffffff;
+		struct TileTriangle{
+			const SetupTriangle* triangle;
+			const SoftTexture* texture;
+		};
+		struct TileState{
+			int x, y, x1, y1; //The tile's pixels, x1 and y1 not included
+			std::vector<TileTriangle> triangles;
+			uint32_t ids[TILE_SIZE * TILE_SIZE]; //Nearest of triangles at each pixel so far
+			//Scratch for shade(): what to sample for each covered pixel, and where it goes
+			float u[TILE_SIZE * TILE_SIZE], v[TILE_SIZE * TILE_SIZE], lod[TILE_SIZE * TILE_SIZE];
+			uint32_t texels[TILE_SIZE * TILE_SIZE];
+			uint32_t pixels[TILE_SIZE * TILE_SIZE];
+		};
+
+		JobSystem* jobs;
+		int tilesX;
+		int tilesY;
+		std::vector<Batch> batches;
+		size_t batchCount;
+
+		template<typename Func>
+		void forEach(size_t count, size_t grainSize, const Func &func){
+			if(jobs) jobs->parallelFor(count, grainSize, func);
+			else if(count > 0) func((size_t)0, count);
+		}
+
+		//0-1 floats to an RGBA8 pixel
+		static uint32_t pack(const glm::vec4 &c){
+			return SoftTexture::packBytes(c * 255.0f);
+		}
+
+		//Which clip planes a vertex is outside of, one bit each. Bit 4 is the near plane.
+		static int outcode(const glm::vec4 &p){
+			return (p.x < -p.w) | (p.x > p.w) << 1 | (p.y < -p.w) << 2 | (p.y > p.w) << 3 |
+				(p.z < -p.w) << 4 | (p.z > p.w) << 5;
+		}
+
+		//The vertex stage, then clipping and setup for every triangle
+		void drawInstance(Batch &batch, const MeshBlobs &mesh, const glm::mat4 &modelViewProjection){
+			batch.clip.resize(mesh.vertexCount);
+			for(uint32_t v = 0; v < mesh.vertexCount; v++){
+				const float* p = mesh.vertices[v].position;
+				batch.clip[v] = modelViewProjection * glm::vec4(p[0], p[1], p[2], 1.0f);
+			}
+			const uint16_t* shortIndices = (const uint16_t*)mesh.indices;
+			const uint32_t* intIndices = (const uint32_t*)mesh.indices;
+			bool shortIndex = mesh.indexType == GL_UNSIGNED_SHORT;
+			for(uint32_t i = 0; i + 2 < mesh.indexCount; i += 3){
+				uint32_t index[3];
+				for(int corner = 0; corner < 3; corner++){
+					index[corner] = shortIndex ? shortIndices[i + corner] : intIndices[i + corner];
+				}
+				int codes[3];
+				for(int corner = 0; corner < 3; corner++){
+					codes[corner] = outcode(batch.clip[index[corner]]);
+				}
+				if(codes[0] & codes[1] & codes[2]) continue; //All outside the same plane
+				ClipVertex corners[3];
+				for(int corner = 0; corner < 3; corner++){
+					corners[corner].position = batch.clip[index[corner]];
+					const float* uv = mesh.vertices[index[corner]].texCoord;
+					corners[corner].texCoord = glm::vec2(uv[0], uv[1]);
+				}
+				if(!((codes[0] | codes[1] | codes[2]) & 16)){
+					setup(batch, corners[0], corners[1], corners[2]);
+					continue;
+				}
+				//Crosses the near plane (z = -w), so cut off the part behind it. What's left
+				//can have 4 corners, which makes 2 triangles.
+				ClipVertex polygon[4];
+				int polygonCount = 0;
+				for(int corner = 0; corner < 3; corner++){
+					const ClipVertex &a = corners[corner];
+					const ClipVertex &b = corners[(corner + 1) % 3];
+					float da = a.position.z + a.position.w;
+					float db = b.position.z + b.position.w;
+					if(da >= 0.0f) polygon[polygonCount++] = a;
+					if((da >= 0.0f) != (db >= 0.0f)){
+						float t = da / (da - db);
+						polygon[polygonCount].position = glm::mix(a.position, b.position, t);
+						polygon[polygonCount].texCoord = glm::mix(a.texCoord, b.texCoord, t);
+						polygonCount++;
+					}
+				}
+				for(int corner = 2; corner < polygonCount; corner++){
+					setup(batch, polygon[0], polygon[corner - 1], polygon[corner]);
+				}
+			}
+		}
+
+		void setup(Batch &batch, const ClipVertex &a, const ClipVertex &b, const ClipVertex &c){
+			//Into window coordinates, with GL's default depth range of 0 to 1
+			const ClipVertex* in[3] = {&a, &b, &c};
+			float x[3], y[3], attributes[4][3];
+			for(int v = 0; v < 3; v++){
+				const glm::vec4 &p = in[v]->position;
+				float inverseW = 1.0f / p.w;
+				x[v] = (p.x * inverseW * 0.5f + 0.5f) * width;
+				y[v] = (p.y * inverseW * 0.5f + 0.5f) * height;
+				attributes[0][v] = p.z * inverseW * 0.5f + 0.5f;
+				attributes[1][v] = inverseW;
+				attributes[2][v] = in[v]->texCoord.x * inverseW;
+				attributes[3][v] = in[v]->texCoord.y * inverseW;
+			}
+			float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+			if(!(std::fabs(area) > 0.0f)) return; //No pixels in it (or NaN)
+			if(area < 0.0f){
+				//Clockwise. Nothing's culled, so turn it around so that inside is positive.
+				std::swap(x[1], x[2]);
+				std::swap(y[1], y[2]);
+				for(int attribute = 0; attribute < 4; attribute++){
+					std::swap(attributes[attribute][1], attributes[attribute][2]);
+				}
+				area = -area;
+			}
+
+			SetupTriangle t;
+			t.minX = std::max(0, (int)std::floor(std::min({x[0], x[1], x[2]})));
+			t.minY = std::max(0, (int)std::floor(std::min({y[0], y[1], y[2]})));
+			t.maxX = std::min(width - 1, (int)std::ceil(std::max({x[0], x[1], x[2]})));
+			t.maxY = std::min(height - 1, (int)std::ceil(std::max({y[0], y[1], y[2]})));
+			if(t.minX > t.maxX || t.minY > t.maxY) return;
+
+			for(int edge = 0; edge < 3; edge++){
+				int next = (edge + 1) % 3;
+				float dx = x[next] - x[edge];
+				float dy = y[next] - y[edge];
+				t.edgeA[edge] = -dy;
+				t.edgeB[edge] = dx;
+				t.edgeC[edge] = dy * x[edge] - dx * y[edge];
+				//Pixels right on an edge belong to whichever triangle has it as a top or left edge,
+				//so where two triangles meet nothing gets drawn twice
+				t.topLeft[edge] = (dy < 0.0f || (dy == 0.0f && dx < 0.0f)) ? 0xffffffff : 0;
+			}
+			for(int attribute = 0; attribute < 4; attribute++){
+				const float* value = attributes[attribute];
+				float dx = ((value[1] - value[0]) * (y[2] - y[0]) - (value[2] - value[0]) * (y[1] - y[0])) / area;
+				float dy = ((value[2] - value[0]) * (x[1] - x[0]) - (value[1] - value[0]) * (x[2] - x[0])) / area;
+				t.planeDX[attribute] = dx;
+				t.planeDY[attribute] = dy;
+				t.planeC[attribute] = value[0] - dx * x[0] - dy * y[0];
+			}
+
+			uint32_t id = batch.triangles.size();
+			batch.triangles.push_back(t);
+			for(int tileY = t.minY / TILE_SIZE; tileY <= t.maxY / TILE_SIZE; tileY++){
+				for(int tileX = t.minX / TILE_SIZE; tileX <= t.maxX / TILE_SIZE; tileX++){
+					batch.bins[tileY * tilesX + tileX].push_back(id);
+				}
+			}
+		}
+
+		//Depth tests the part of the tile's triangle id inside the tile, in 8x8 blocks of
+		//4 pixel rows. Blocks entirely outside an edge get skipped, and edges a block is
+		//entirely inside don't need testing for it.
+		void rasterize(TileState &tile, uint32_t id){
+			const SetupTriangle &t = *tile.triangles[id].triangle;
+			int blockX0 = std::max(t.minX, tile.x) & ~7; //Tiles start on a multiple of 8, so this stays in the tile
+			int blockY0 = std::max(t.minY, tile.y) & ~7;
+			int x1 = std::min(t.maxX, tile.x1 - 1);
+			int y1 = std::min(t.maxY, tile.y1 - 1);
+
+#if defined(__SSE2__)
+			const __m128 zero = _mm_setzero_ps();
+			const __m128 laneCenters = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+			const __m128 right = _mm_set1_ps((float)tile.x1);
+			const __m128i ids = _mm_set1_epi32(id);
+			__m128 edgeA[3], topLeft[3];
+			for(int edge = 0; edge < 3; edge++){
+				edgeA[edge] = _mm_set1_ps(t.edgeA[edge]);
+				topLeft[edge] = _mm_castsi128_ps(_mm_set1_epi32(t.topLeft[edge]));
+			}
+			const __m128 depthDX = _mm_set1_ps(t.planeDX[0]);
+#endif
+
+			for(int blockY = blockY0; blockY <= y1; blockY += 8){
+				for(int blockX = blockX0; blockX <= x1; blockX += 8){
+					//Each edge function is lowest and highest at opposite corners of the block
+					bool test[3];
+					bool outside = false;
+					for(int edge = 0; edge < 3; edge++){
+						float a = t.edgeA[edge], b = t.edgeB[edge], c = t.edgeC[edge];
+						float lowX = blockX + (a >= 0.0f ? 0.5f : 7.5f), highX = blockX + (a >= 0.0f ? 7.5f : 0.5f);
+						float lowY = blockY + (b >= 0.0f ? 0.5f : 7.5f), highY = blockY + (b >= 0.0f ? 7.5f : 0.5f);
+						if(a * highX + b * highY + c < 0.0f) outside = true;
+						test[edge] = a * lowX + b * lowY + c <= 0.0f;
+					}
+					if(outside) continue;
+
+					int rowEnd = std::min(blockY + 7, y1);
+					int columnEnd = std::min(blockX + 7, x1);
+					for(int y = blockY; y <= rowEnd; y++){
+						float centerY = y + 0.5f;
+						float* depthRow = &depth[(size_t)y * stride];
+						uint32_t* idRow = &tile.ids[(y - tile.y) * TILE_SIZE]; //Indexed from the tile's left edge
+#if defined(__SSE2__)
+						__m128 edgeRow[3];
+						for(int edge = 0; edge < 3; edge++){
+							edgeRow[edge] = _mm_set1_ps(t.edgeB[edge] * centerY + t.edgeC[edge]);
+						}
+						__m128 depthRow0 = _mm_set1_ps(t.planeDY[0] * centerY + t.planeC[0]);
+
+						for(int x = blockX; x <= columnEnd; x += 4){
+							__m128 centerX = _mm_add_ps(_mm_set1_ps((float)x), laneCenters);
+							__m128 inside = _mm_cmplt_ps(centerX, right);
+							for(int edge = 0; edge < 3; edge++){
+								if(!test[edge]) continue;
+								__m128 e = _mm_add_ps(_mm_mul_ps(edgeA[edge], centerX), edgeRow[edge]);
+								__m128 onEdge = _mm_and_ps(_mm_cmpeq_ps(e, zero), topLeft[edge]);
+								inside = _mm_and_ps(inside, _mm_or_ps(_mm_cmpgt_ps(e, zero), onEdge));
+							}
+							if(!_mm_movemask_ps(inside)) continue;
+
+							__m128 z = _mm_add_ps(_mm_mul_ps(depthDX, centerX), depthRow0);
+							__m128 oldZ = _mm_loadu_ps(depthRow + x);
+							__m128 pass = _mm_and_ps(inside, _mm_cmplt_ps(z, oldZ));
+							if(!_mm_movemask_ps(pass)) continue;
+							_mm_storeu_ps(depthRow + x, _mm_or_ps(_mm_and_ps(pass, z), _mm_andnot_ps(pass, oldZ)));
+							__m128i passInt = _mm_castps_si128(pass);
+							__m128i oldIds = _mm_loadu_si128((const __m128i*)(idRow + x - tile.x));
+							_mm_storeu_si128((__m128i*)(idRow + x - tile.x), _mm_or_si128(_mm_and_si128(passInt, ids), _mm_andnot_si128(passInt, oldIds)));
+						}
+#else
+						float edgeRow[3];
+						for(int edge = 0; edge < 3; edge++){
+							edgeRow[edge] = t.edgeB[edge] * centerY + t.edgeC[edge];
+						}
+						float depthRow0 = t.planeDY[0] * centerY + t.planeC[0];
+
+						//The same pixels the SSE path covers: whole groups of 4, up to the tile's edge
+						int groupEnd = std::min(blockX + ((columnEnd - blockX) & ~3) + 4, tile.x1);
+						for(int x = blockX; x < groupEnd; x++){
+							float centerX = x + 0.5f;
+							bool inside = true;
+							for(int edge = 0; edge < 3 && inside; edge++){
+								if(!test[edge]) continue;
+								float e = t.edgeA[edge] * centerX + edgeRow[edge];
+								inside = e > 0.0f || (e == 0.0f && t.topLeft[edge]);
+							}
+							if(!inside) continue;
+
+							float z = t.planeDX[0] * centerX + depthRow0;
+							if(z < depthRow[x]){
+								depthRow[x] = z;
+								idRow[x - tile.x] = id;
+							}
+						}
+#endif
+					}
+				}
+			}
+		}
+
+		//The fragment shader, for whatever ended up in front at each of the tile's pixels.
+		//Works out every pixel's texture coordinates first, then has the texture filter
+		//them as one list rather than a pixel at a time.
+		void shade(TileState &tile){
+			size_t count = 0;
+			const SoftTexture* texture = NULL;
+			for(int y = tile.y; y < tile.y1; y++){
+				float centerY = y + 0.5f;
+				const uint32_t* idRow = &tile.ids[(y - tile.y) * TILE_SIZE]; //Indexed from the tile's left edge
+				for(int x = tile.x; x < tile.x1; x++){
+					uint32_t id = idRow[x - tile.x];
+					if(id == NO_TRIANGLE) continue;
+					if(tile.triangles[id].texture != texture){
+						sampleTile(tile, texture, count);
+						texture = tile.triangles[id].texture;
+						count = 0;
+					}
+					const SetupTriangle &t = *tile.triangles[id].triangle;
+					float centerX = x + 0.5f;
+					//Undo the divide by w that made u and v linear across the screen
+					float w = 1.0f / (t.planeDX[1] * centerX + t.planeDY[1] * centerY + t.planeC[1]);
+					float u = (t.planeDX[2] * centerX + t.planeDY[2] * centerY + t.planeC[2]) * w;
+					float v = (t.planeDX[3] * centerX + t.planeDY[3] * centerY + t.planeC[3]) * w;
+					tile.u[count] = u;
+					tile.v[count] = v;
+					if(texture->filter == SoftTexture::TRILINEAR){
+						//How far u and v move a pixel across and a pixel up, in texels: the
+						//derivative of (u/w) / (1/w), which the planes give exactly
+						float dudx = (t.planeDX[2] - u * t.planeDX[1]) * w * texture->width;
+						float dvdx = (t.planeDX[3] - v * t.planeDX[1]) * w * texture->height;
+						float dudy = (t.planeDY[2] - u * t.planeDY[1]) * w * texture->width;
+						float dvdy = (t.planeDY[3] - v * t.planeDY[1]) * w * texture->height;
+						float rho = std::max(dudx * dudx + dvdx * dvdx, dudy * dudy + dvdy * dvdy);
+						tile.lod[count] = 0.5f * std::log2(std::max(rho, 1e-12f));
+					}
+					tile.pixels[count] = (size_t)y * stride + x;
+					count++;
+				}
+			}
+			sampleTile(tile, texture, count);
+		}
+
+		//Filters the first count of the coordinates shade() gathered, and writes them out
+		void sampleTile(TileState &tile, const SoftTexture* texture, size_t count){
+			if(count == 0) return;
+			texture->sample(tile.u, tile.v, texture->filter == SoftTexture::TRILINEAR ? tile.lod : NULL, tile.texels, count);
+			for(size_t i = 0; i < count; i++){
+				color[tile.pixels[i]] = tile.texels[i];
+			}
+		}
+};
+
+#endif
@@ -0,0 +1,495 @@
+#ifndef SOFTTEXTURE_H
+#define SOFTTEXTURE_H
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "mipmaps.h"
+#include "textureloader.h"
+
+//For std::vector, so its storage starts on a 64 byte cache line
+template<typename T>
+struct CacheLineAllocator{
+	typedef T value_type;
+
+	CacheLineAllocator(){}
+	template<typename U>
+	CacheLineAllocator(const CacheLineAllocator<U>&){}
+
+	T* allocate(size_t count){
+		void* memory;
+		if(posix_memalign(&memory, 64, count * sizeof(T)) != 0) throw std::bad_alloc();
+		return (T*)memory;
+	}
+
+	void deallocate(T* memory, size_t){
+		free(memory);
+	}
+
+	template<typename U>
+	bool operator==(const CacheLineAllocator<U>&) const{ return true; }
+	template<typename U>
+	bool operator!=(const CacheLineAllocator<U>&) const{ return false; }
+};
+
+//An RGBA8 texture (and its mip chain) in CPU memory, for drawing and sampling without GL:
+//the software rasterizer, thumbnails, reference images and so on.
+//
+//Texels aren't stored row by row. Each 4x4 block of them is one 64 byte cache line, in
+//Morton (Z) order inside the block, and blocks go row by row. A bilinear footprint then
+//nearly always sits in one line whichever way the texture is turned, where rows would
+//need two lines and, once it's rotated, hardly ever the same ones as the next pixel over.
+//
+//sample() filters a whole list of coordinates at once: 8 per step with AVX2 gathers
+//when the CPU has them, otherwise 4 per step with SSE2. Off x86 it goes one at a time.
+class SoftTexture{
+	public:
+		//Like GL_REPEAT and GL_CLAMP_TO_EDGE
+		enum Wrap{ REPEAT, CLAMP };
+		//Like GL_LINEAR (level 0 only) and GL_LINEAR_MIPMAP_LINEAR
+		enum Filter{ BILINEAR, TRILINEAR };
+
+		Wrap wrap;
+		Filter filter;
+		int width; //Of level 0
+		int height;
+
+		//Same defaults as the textures TextureLoader makes
+		SoftTexture() : wrap(REPEAT), filter(BILINEAR), width(0), height(0){}
+
+		//Takes a copy of a decoded image, expanded to RGBA8 the same way the GL upload swizzles
+		//it, and builds the rest of the mip chain
+		bool load(const Image &image){
+			if(!image.data) return false;
+			width = image.width;
+			height = image.height;
+			std::vector<unsigned char> rgba((size_t)width * height * 4);
+			for(size_t i = 0; i < (size_t)width * height; i++){
+				unsigned char channel[4] = {0, 0, 0, 255};
+				for(int c = 0; c < image.channels && c < 4; c++){
+					size_t at = (i * image.channels + c) * image.bytesPerChannel;
+					//16-bit channels are native endian, so the top byte is the second one on x86
+					channel[c] = image.data[at + image.bytesPerChannel - 1];
+				}
+				unsigned char* out = &rgba[i * 4];
+				if(image.channels <= 2){
+					out[0] = out[1] = out[2] = channel[0];
+					out[3] = image.channels == 2 ? channel[1] : 255;
+				} else {
+					out[0] = channel[0];
+					out[1] = channel[1];
+					out[2] = channel[2];
+					out[3] = image.channels == 4 ? channel[3] : 255;
+				}
+			}
+			std::vector<MipLevel> mips = MipGenerator::generate(rgba.data(), width, height, 4, 1);
+
+			levels.clear();
+			texels.clear();
+			addLevel(rgba.data(), width, height);
+			for(const MipLevel &mip : mips){
+				addLevel(mip.data.data(), mip.width, mip.height);
+			}
+			levelWidths.clear();
+			levelHeights.clear();
+			levelTilesX.clear();
+			levelOffsets.clear();
+			for(const Level &level : levels){
+				levelWidths.push_back(level.width);
+				levelHeights.push_back(level.height);
+				levelTilesX.push_back(level.tilesX);
+				levelOffsets.push_back(level.offset);
+			}
+			return true;
+		}
+
+		//Filters count texels at (u[i], v[i]) into out[i], packed RGBA8 (R in the low byte).
+		//lod is the mip level (log2 of texels per pixel) for each, only used with TRILINEAR,
+		//and can be NULL for level 0.
+		void sample(const float* u, const float* v, const float* lod, uint32_t* out, size_t count) const{
+			if(levels.empty()){
+				//Nothing loaded, so plain white
+				std::fill(out, out + count, 0xffffffff);
+				return;
+			}
+			if(filter == BILINEAR) lod = NULL;
+#if defined(__SSE2__)
+			static const bool hasAVX2 = __builtin_cpu_supports("avx2");
+			size_t i = 0;
+			if(hasAVX2){
+				for(; i + 8 <= count; i += 8){
+					sampleAVX2(u + i, v + i, lod ? lod + i : NULL, out + i);
+				}
+			}
+			for(; i + 4 <= count; i += 4){
+				sampleSSE(u + i, v + i, lod ? lod + i : NULL, out + i);
+			}
+			size_t rest = count - i;
+			if(rest > 0){
+				//Pad what's left out to a full 4
+				float lastU[4] = {0}, lastV[4] = {0}, lastLod[4] = {0};
+				uint32_t lastOut[4];
+				for(size_t j = 0; j < rest && j < 4; j++){
+					lastU[j] = u[i + j];
+					lastV[j] = v[i + j];
+					if(lod) lastLod[j] = lod[i + j];
+				}
+				sampleSSE(lastU, lastV, lod ? lastLod : NULL, lastOut);
+				for(size_t j = 0; j < rest && j < 4; j++){
+					out[i + j] = lastOut[j];
+				}
+			}
+#else
+			for(size_t i = 0; i < count; i++){
+				out[i] = sampleOne(u[i], v[i], lod ? lod + i : NULL);
+			}
+#endif
+		}
+
+		//One filtered texel, 0-1 per channel. Handy, but use the list version for anything big.
+		glm::vec4 sample(float u, float v, float lod = 0.0f) const{
+			uint32_t texel;
+			sample(&u, &v, &lod, &texel, 1);
+			return glm::vec4(texel & 0xff, (texel >> 8) & 0xff, (texel >> 16) & 0xff, texel >> 24) * (1.0f / 255.0f);
+		}
+
+		//0-255 floats to bytes, rounding to nearest (even on ties) like GL does
+		static uint32_t packBytes(const glm::vec4 &bytes){
+#if defined(__SSE2__)
+			__m128 clamped = _mm_min_ps(_mm_max_ps(_mm_setr_ps(bytes.r, bytes.g, bytes.b, bytes.a), _mm_setzero_ps()), _mm_set1_ps(255.0f));
+			__m128i rounded = _mm_cvtps_epi32(clamped);
+			rounded = _mm_packs_epi32(rounded, rounded);
+			return _mm_cvtsi128_si32(_mm_packus_epi16(rounded, rounded));
+#else
+			uint32_t packed = 0;
+			for(int channel = 0; channel < 4; channel++){
+				packed |= (uint32_t)std::lrint(std::min(std::max(bytes[channel], 0.0f), 255.0f)) << (channel * 8);
+			}
+			return packed;
+#endif
+		}
+
+	private:
+		struct Level{
+			int width;
+			int height;
+			int tilesX; //4x4 blocks per row of blocks
+			int offset; //Where the level starts in texels
+		};
+		std::vector<Level> levels;
+		//Levels start on whole blocks, so with the storage itself cache line aligned every
+		//block is exactly one line
+		std::vector<uint32_t, CacheLineAllocator<uint32_t>> texels;
+		//The same as levels, split up so the AVX2 path can gather from them
+		std::vector<float> levelWidths, levelHeights;
+		std::vector<int> levelTilesX, levelOffsets;
+
+		//Where texel (x, y) of a level lives in texels
+		static int address(const Level &level, int x, int y){
+			int block = (y >> 2) * level.tilesX + (x >> 2);
+			int morton = (x & 1) | ((y & 1) << 1) | ((x & 2) << 1) | ((y & 2) << 2);
+			return level.offset + block * 16 + morton;
+		}
+
+		void addLevel(const unsigned char* rgba, int levelWidth, int levelHeight){
+			Level level;
+			level.width = levelWidth;
+			level.height = levelHeight;
+			level.tilesX = (levelWidth + 3) / 4;
+			level.offset = texels.size();
+			//Padded out to whole blocks. The padding never gets sampled.
+			texels.resize(texels.size() + (size_t)level.tilesX * ((levelHeight + 3) / 4) * 16, 0);
+			const uint32_t* source = (const uint32_t*)rgba;
+			for(int y = 0; y < levelHeight; y++){
+				for(int x = 0; x < levelWidth; x++){
+					texels[address(level, x, y)] = source[(size_t)y * levelWidth + x];
+				}
+			}
+			levels.push_back(level);
+		}
+
+#if defined(__SSE2__)
+		//SSE2 has no floor of its own
+		static __m128 floorSSE(__m128 x){
+			__m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+			return _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, x), _mm_set1_ps(1.0f)));
+		}
+
+		//Texel coordinate x (already floored) and the one after it, wrapped into 0 to size - 1
+		void wrapSSE(__m128 x, __m128 size, __m128i &first, __m128i &second) const{
+			const __m128 one = _mm_set1_ps(1.0f);
+			if(wrap == CLAMP){
+				__m128 last = _mm_sub_ps(size, one);
+				first = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(x, _mm_setzero_ps()), last));
+				second = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(_mm_add_ps(x, one), _mm_setzero_ps()), last));
+				return;
+			}
+			__m128 wrapped = _mm_sub_ps(x, _mm_mul_ps(size, floorSSE(_mm_div_ps(x, size))));
+			//(The divide can land a hair off near multiples of size)
+			wrapped = _mm_sub_ps(wrapped, _mm_and_ps(_mm_cmpge_ps(wrapped, size), size));
+			wrapped = _mm_add_ps(wrapped, _mm_and_ps(_mm_cmplt_ps(wrapped, _mm_setzero_ps()), size));
+			__m128 next = _mm_add_ps(wrapped, one);
+			next = _mm_andnot_ps(_mm_cmpge_ps(next, size), next);
+			first = _mm_cvttps_epi32(wrapped);
+			second = _mm_cvttps_epi32(next);
+		}
+
+		//Bilinear filtering of 4 coordinates, each at its own level (or all at level 0 if
+		//level is NULL). Comes out as 0-255, one vector per channel.
+		void bilinearSSE(__m128 u, __m128 v, const int* level, __m128 channels[4]) const{
+			__m128 width, height;
+			if(level){
+				width = _mm_setr_ps(levels[level[0]].width, levels[level[1]].width, levels[level[2]].width, levels[level[3]].width);
+				height = _mm_setr_ps(levels[level[0]].height, levels[level[1]].height, levels[level[2]].height, levels[level[3]].height);
+			} else {
+				width = _mm_set1_ps(levels[0].width);
+				height = _mm_set1_ps(levels[0].height);
+			}
+			//Texel centers are at half coordinates, same as GL. Keep far-off coordinates
+			//somewhere floats still count in whole texels.
+			const __m128 limit = _mm_set1_ps(1 << 22);
+			__m128 x = _mm_sub_ps(_mm_mul_ps(u, width), _mm_set1_ps(0.5f));
+			__m128 y = _mm_sub_ps(_mm_mul_ps(v, height), _mm_set1_ps(0.5f));
+			x = _mm_min_ps(_mm_max_ps(x, _mm_sub_ps(_mm_setzero_ps(), limit)), limit);
+			y = _mm_min_ps(_mm_max_ps(y, _mm_sub_ps(_mm_setzero_ps(), limit)), limit);
+			__m128 x0 = floorSSE(x), y0 = floorSSE(y);
+			__m128 fx = _mm_sub_ps(x, x0), fy = _mm_sub_ps(y, y0);
+			__m128i xs[2], ys[2];
+			wrapSSE(x0, width, xs[0], xs[1]);
+			wrapSSE(y0, height, ys[0], ys[1]);
+
+			//No gathers before AVX2, so the loads themselves go one at a time
+			int xi[2][4], yi[2][4];
+			for(int i = 0; i < 2; i++){
+				_mm_storeu_si128((__m128i*)xi[i], xs[i]);
+				_mm_storeu_si128((__m128i*)yi[i], ys[i]);
+			}
+			uint32_t corner[4][4]; //00, 10, 01, 11, then lane
+			for(int lane = 0; lane < 4; lane++){
+				const Level &l = levels[level ? level[lane] : 0];
+				corner[0][lane] = texels[address(l, xi[0][lane], yi[0][lane])];
+				corner[1][lane] = texels[address(l, xi[1][lane], yi[0][lane])];
+				corner[2][lane] = texels[address(l, xi[0][lane], yi[1][lane])];
+				corner[3][lane] = texels[address(l, xi[1][lane], yi[1][lane])];
+			}
+			__m128i t[4];
+			for(int c = 0; c < 4; c++){
+				t[c] = _mm_loadu_si128((const __m128i*)corner[c]);
+			}
+			const __m128i mask = _mm_set1_epi32(0xff);
+			for(int channel = 0; channel < 4; channel++){
+				__m128 value[4];
+				for(int c = 0; c < 4; c++){
+					value[c] = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(t[c], channel * 8), mask));
+				}
+				__m128 bottom = _mm_add_ps(value[0], _mm_mul_ps(_mm_sub_ps(value[1], value[0]), fx));
+				__m128 top = _mm_add_ps(value[2], _mm_mul_ps(_mm_sub_ps(value[3], value[2]), fx));
+				channels[channel] = _mm_add_ps(bottom, _mm_mul_ps(_mm_sub_ps(top, bottom), fy));
+			}
+		}
+
+		//0-255 channels back to packed texels, rounding to nearest (even on ties) like GL does
+		static __m128i packSSE(const __m128 channels[4]){
+			__m128i packed = _mm_setzero_si128();
+			for(int channel = 0; channel < 4; channel++){
+				__m128 clamped = _mm_min_ps(_mm_max_ps(channels[channel], _mm_setzero_ps()), _mm_set1_ps(255.0f));
+				packed = _mm_or_si128(packed, _mm_slli_epi32(_mm_cvtps_epi32(clamped), channel * 8));
+			}
+			return packed;
+		}
+
+		void sampleSSE(const float* u, const float* v, const float* lod, uint32_t* out) const{
+			__m128 uv[2] = {_mm_loadu_ps(u), _mm_loadu_ps(v)};
+			__m128 channels[4];
+			if(!lod){
+				bilinearSSE(uv[0], uv[1], NULL, channels);
+				_mm_storeu_si128((__m128i*)out, packSSE(channels));
+				return;
+			}
+			//Between the two nearest levels
+			__m128 maxLevel = _mm_set1_ps(levels.size() - 1);
+			__m128 clamped = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(lod), _mm_setzero_ps()), maxLevel);
+			__m128 level0 = floorSSE(clamped);
+			__m128 blend = _mm_sub_ps(clamped, level0);
+			int first[4], second[4];
+			_mm_storeu_si128((__m128i*)first, _mm_cvttps_epi32(level0));
+			_mm_storeu_si128((__m128i*)second, _mm_cvttps_epi32(_mm_min_ps(_mm_add_ps(level0, _mm_set1_ps(1.0f)), maxLevel)));
+			__m128 finer[4];
+			bilinearSSE(uv[0], uv[1], first, finer);
+			bilinearSSE(uv[0], uv[1], second, channels);
+			for(int channel = 0; channel < 4; channel++){
+				channels[channel] = _mm_add_ps(finer[channel], _mm_mul_ps(_mm_sub_ps(channels[channel], finer[channel]), blend));
+			}
+			_mm_storeu_si128((__m128i*)out, packSSE(channels));
+		}
+
+		//The same again, 8 wide
+		__attribute__((target("avx2")))
+		void wrapAVX2(__m256 x, __m256 size, __m256i &first, __m256i &second) const{
+			const __m256 one = _mm256_set1_ps(1.0f);
+			const __m256 zero = _mm256_setzero_ps();
+			if(wrap == CLAMP){
+				__m256 last = _mm256_sub_ps(size, one);
+				first = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(x, zero), last));
+				second = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_add_ps(x, one), zero), last));
+				return;
+			}
+			__m256 wrapped = _mm256_sub_ps(x, _mm256_mul_ps(size, _mm256_floor_ps(_mm256_div_ps(x, size))));
+			wrapped = _mm256_sub_ps(wrapped, _mm256_and_ps(_mm256_cmp_ps(wrapped, size, _CMP_GE_OQ), size));
+			wrapped = _mm256_add_ps(wrapped, _mm256_and_ps(_mm256_cmp_ps(wrapped, zero, _CMP_LT_OQ), size));
+			__m256 next = _mm256_add_ps(wrapped, one);
+			next = _mm256_andnot_ps(_mm256_cmp_ps(next, size, _CMP_GE_OQ), next);
+			first = _mm256_cvttps_epi32(wrapped);
+			second = _mm256_cvttps_epi32(next);
+		}
+
+		__attribute__((target("avx2")))
+		void bilinearAVX2(__m256 u, __m256 v, __m256i level, __m256 channels[4]) const{
+			__m256 width = _mm256_i32gather_ps(levelWidths.data(), level, 4);
+			__m256 height = _mm256_i32gather_ps(levelHeights.data(), level, 4);
+			__m256i tilesX = _mm256_i32gather_epi32(levelTilesX.data(), level, 4);
+			__m256i offset = _mm256_i32gather_epi32(levelOffsets.data(), level, 4);
+			const __m256 limit = _mm256_set1_ps(1 << 22);
+			__m256 x = _mm256_sub_ps(_mm256_mul_ps(u, width), _mm256_set1_ps(0.5f));
+			__m256 y = _mm256_sub_ps(_mm256_mul_ps(v, height), _mm256_set1_ps(0.5f));
+			x = _mm256_min_ps(_mm256_max_ps(x, _mm256_sub_ps(_mm256_setzero_ps(), limit)), limit);
+			y = _mm256_min_ps(_mm256_max_ps(y, _mm256_sub_ps(_mm256_setzero_ps(), limit)), limit);
+			__m256 x0 = _mm256_floor_ps(x), y0 = _mm256_floor_ps(y);
+			__m256 fx = _mm256_sub_ps(x, x0), fy = _mm256_sub_ps(y, y0);
+			__m256i xs[2], ys[2];
+			wrapAVX2(x0, width, xs[0], xs[1]);
+			wrapAVX2(y0, height, ys[0], ys[1]);
+
+			//address() for all 8 at once: the block, then Morton order inside it
+			const __m256i one = _mm256_set1_epi32(1), two = _mm256_set1_epi32(2);
+			__m256i blockX[2], blockY[2], mortonX[2], mortonY[2];
+			for(int i = 0; i < 2; i++){
+				blockX[i] = _mm256_srli_epi32(xs[i], 2);
+				blockY[i] = _mm256_mullo_epi32(_mm256_srli_epi32(ys[i], 2), tilesX);
+				mortonX[i] = _mm256_or_si256(_mm256_and_si256(xs[i], one), _mm256_slli_epi32(_mm256_and_si256(xs[i], two), 1));
+				mortonY[i] = _mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(ys[i], one), 1), _mm256_slli_epi32(_mm256_and_si256(ys[i], two), 2));
+			}
+			__m256i t[4];
+			for(int c = 0; c < 4; c++){
+				int i = c & 1, j = c >> 1; //00, 10, 01, 11
+				__m256i block = _mm256_add_epi32(blockY[j], blockX[i]);
+				__m256i texel = _mm256_add_epi32(offset, _mm256_slli_epi32(block, 4));
+				texel = _mm256_add_epi32(texel, _mm256_or_si256(mortonX[i], mortonY[j]));
+				t[c] = _mm256_i32gather_epi32((const int*)texels.data(), texel, 4);
+			}
+			const __m256i mask = _mm256_set1_epi32(0xff);
+			for(int channel = 0; channel < 4; channel++){
+				__m256 value[4];
+				for(int c = 0; c < 4; c++){
+					value[c] = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(t[c], channel * 8), mask));
+				}
+				__m256 bottom = _mm256_add_ps(value[0], _mm256_mul_ps(_mm256_sub_ps(value[1], value[0]), fx));
+				__m256 top = _mm256_add_ps(value[2], _mm256_mul_ps(_mm256_sub_ps(value[3], value[2]), fx));
+				channels[channel] = _mm256_add_ps(bottom, _mm256_mul_ps(_mm256_sub_ps(top, bottom), fy));
+			}
+		}
+
+		__attribute__((target("avx2")))
+		void sampleAVX2(const float* u, const float* v, const float* lod, uint32_t* out) const{
+			__m256 uv[2] = {_mm256_loadu_ps(u), _mm256_loadu_ps(v)};
+			__m256 channels[4];
+			if(!lod){
+				bilinearAVX2(uv[0], uv[1], _mm256_setzero_si256(), channels);
+			} else {
+				__m256 maxLevel = _mm256_set1_ps(levels.size() - 1);
+				__m256 clamped = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(lod), _mm256_setzero_ps()), maxLevel);
+				__m256 level0 = _mm256_floor_ps(clamped);
+				__m256 blend = _mm256_sub_ps(clamped, level0);
+				__m256 level1 = _mm256_min_ps(_mm256_add_ps(level0, _mm256_set1_ps(1.0f)), maxLevel);
+				__m256 finer[4];
+				bilinearAVX2(uv[0], uv[1], _mm256_cvttps_epi32(level0), finer);
+				bilinearAVX2(uv[0], uv[1], _mm256_cvttps_epi32(level1), channels);
+				for(int channel = 0; channel < 4; channel++){
+					channels[channel] = _mm256_add_ps(finer[channel], _mm256_mul_ps(_mm256_sub_ps(channels[channel], finer[channel]), blend));
+				}
+			}
+			__m256i packed = _mm256_setzero_si256();
+			for(int channel = 0; channel < 4; channel++){
+				__m256 clamped = _mm256_min_ps(_mm256_max_ps(channels[channel], _mm256_setzero_ps()), _mm256_set1_ps(255.0f));
+				packed = _mm256_or_si256(packed, _mm256_slli_epi32(_mm256_cvtps_epi32(clamped), channel * 8));
+			}
+			_mm256_storeu_si256((__m256i*)out, packed);
+		}
+#else
+		//Texel coordinate x (already floored) and the one after it, wrapped into 0 to size - 1
+		void wrapTexel(float x, float size, int &first, int &second) const{
+			if(wrap == CLAMP){
+				float last = size - 1.0f;
+				first = (int)std::min(std::max(x, 0.0f), last);
+				second = (int)std::min(std::max(x + 1.0f, 0.0f), last);
+				return;
+			}
+			float wrapped = x - size * std::floor(x / size);
+			//(The divide can land a hair off near multiples of size)
+			if(wrapped >= size) wrapped -= size;
+			if(wrapped < 0.0f) wrapped += size;
+			float next = wrapped + 1.0f;
+			if(next >= size) next = 0.0f;
+			first = (int)wrapped;
+			second = (int)next;
+		}
+
+		//Bilinear filtering of one coordinate at one level. Comes out as 0-255 per channel.
+		glm::vec4 bilinear(float u, float v, int level) const{
+			const Level &l = levels[level];
+			//Same as bilinearSSE: texel centers at half coordinates, far-off coordinates kept in range.
+			//Written out rather than std::max so a NaN ends up at -limit too, like maxps puts it.
+			const float limit = 1 << 22;
+			float x = u * l.width - 0.5f, y = v * l.height - 0.5f;
+			x = x > -limit ? x : -limit;
+			y = y > -limit ? y : -limit;
+			x = std::min(x, limit);
+			y = std::min(y, limit);
+			float x0 = std::floor(x), y0 = std::floor(y);
+			float fx = x - x0, fy = y - y0;
+			int xs[2], ys[2];
+			wrapTexel(x0, l.width, xs[0], xs[1]);
+			wrapTexel(y0, l.height, ys[0], ys[1]);
+			uint32_t t[4] = { //00, 10, 01, 11
+				texels[address(l, xs[0], ys[0])], texels[address(l, xs[1], ys[0])],
+				texels[address(l, xs[0], ys[1])], texels[address(l, xs[1], ys[1])]
+			};
+			glm::vec4 channels;
+			for(int channel = 0; channel < 4; channel++){
+				float value[4];
+				for(int c = 0; c < 4; c++){
+					value[c] = (float)((t[c] >> (channel * 8)) & 0xff);
+				}
+				float bottom = value[0] + (value[1] - value[0]) * fx;
+				float top = value[2] + (value[3] - value[2]) * fx;
+				channels[channel] = bottom + (top - bottom) * fy;
+			}
+			return channels;
+		}
+
+		uint32_t sampleOne(float u, float v, const float* lod) const{
+			if(!lod) return packBytes(bilinear(u, v, 0));
+			//Between the two nearest levels
+			float maxLevel = levels.size() - 1;
+			float clamped = std::min(*lod > 0.0f ? *lod : 0.0f, maxLevel); //NaN goes to 0, as in sampleSSE
+			float level0 = std::floor(clamped);
+			float blend = clamped - level0;
+			glm::vec4 finer = bilinear(u, v, (int)level0);
+			glm::vec4 coarser = bilinear(u, v, (int)std::min(level0 + 1.0f, maxLevel));
+			return packBytes(finer + (coarser - finer) * blend);
+		}
+#endif
+};
+
+#endif
@@ -0,0 +1,234 @@
+#ifndef TEXTURELOADER_H
+#define TEXTURELOADER_H
+
+#include <epoxy/gl.h>
+#include <epoxy/glx.h>
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "stb_image.h"
+#include "mipmaps.h"
+
+//A decoded image in CPU memory, waiting to be uploaded
+struct Image{
+	std::string path;
+	int width;
+	int height;
+	int channels; //Of the decoded data, which may be more than the file has
+	int bytesPerChannel; //1, or 2 for 16-bit images
+	unsigned char* data; //From stb_image, NULL if loading failed
+	std::vector<MipLevel> mips; //Levels 1 and up, if we made them ourselves
+
+	size_t rowBytes() const{
+		return (size_t)width * channels * bytesPerChannel;
+	}
+
+	void release(){
+		stbi_image_free(data);
+		data = NULL;
+		mips.clear();
+	}
+};
+
+//How to hand an Image to glTexImage2D and friends
+struct TextureFormat{
+	GLenum internalFormat;
+	GLenum format;
+	GLenum type;
+};
+
+//Loads textures using the stb_image library and puts them in OpenGL textures.
+//Decoding PNGs is slow and every image is independent, so we decode them all at
+//once on a pool of worker threads. Only the GL uploads happen on the calling
+//thread, which has to be the one that owns the context.
+class TextureLoader{
+	public:
+		unsigned int threadCount;
+		//Build mipmaps on the decode threads, upload them into immutable storage and
+		//filter between them. Otherwise textures get a single level.
+		bool cpuMipmaps;
+
+		TextureLoader(unsigned int threadCount = std::thread::hardware_concurrency())
+			: threadCount(std::max(1u, threadCount)), cpuMipmaps(false){}
+
+		//Returns one texture per path, in the same order.
+		//Pass decoded to keep the decoded images for use on the CPU as well; releasing them
+		//is then up to the caller.
+		std::vector<unsigned int> loadTextures(const std::vector<std::string> &paths, std::vector<Image>* decoded = NULL){
+			std::vector<Image> images = decodeAll(paths);
+			std::vector<unsigned int> textures;
+			for(Image &image : images){
+				textures.push_back(upload(image));
+				if(!decoded) image.release(); //We're done with the loaded image file now.
+			}
+			if(decoded) *decoded = images;
+			return textures;
+		}
+
+		std::vector<Image> decodeAll(const std::vector<std::string> &paths){
+			std::vector<Image> images(paths.size());
+			//Each worker grabs the next undecoded image until there are none left.
+			std::atomic<size_t> next(0);
+			auto work = [&](){
+				for(size_t i = next++; i < paths.size(); i = next++){
+					images[i] = decode(paths[i]);
+					Image &image = images[i];
+					if(cpuMipmaps && image.data){
+						image.mips = MipGenerator::generate(image.data, image.width, image.height, image.channels, image.bytesPerChannel);
+					}
+				}
+			};
+			std::vector<std::thread> workers;
+			unsigned int workerCount = std::min<size_t>(threadCount, paths.size());
+			for(unsigned int i = 1; i < workerCount; i++){
+				workers.push_back(std::thread(work));
+			}
+			work(); //This thread pitches in too
+			for(std::thread &worker : workers){
+				worker.join();
+			}
+			return images;
+		}
+
+		//Safe to call from any thread
+		static Image decode(const std::string &path){
+			Image image;
+			image.path = path;
+			//The plain stbi_set_flip_vertically_on_load() is a global shared by every thread;
+			//the _thread version only affects this one.
+			stbi_set_flip_vertically_on_load_thread(true);
+			image.data = NULL;
+			image.channels = 0;
+			image.bytesPerChannel = 1;
+			int fileChannels;
+			if(stbi_info(path.c_str(), &image.width, &image.height, &fileChannels)){
+				//Drivers generally keep textures as 4 channels internally, so RGB data has to be
+				//expanded on the CPU during upload anyway. Better that stb does it once here.
+				int wantChannels = fileChannels == 3 ? 4 : 0;
+				if(stbi_is_16_bit(path.c_str())){
+					image.bytesPerChannel = 2;
+					image.data = (unsigned char*)stbi_load_16(path.c_str(), &image.width, &image.height, &fileChannels, wantChannels);
+				} else {
+					image.data = stbi_load(path.c_str(), &image.width, &image.height, &fileChannels, wantChannels);
+				}
+				image.channels = wantChannels ? wantChannels : fileChannels;
+			}
+			if(!image.data){
+				std::cout << "Failed to load texture " << path << std::endl;
+			}
+			return image;
+		}
+
+		//Pick GL formats that match the decoded data exactly, so the driver can copy
+		//it straight in instead of converting it pixel by pixel
+		static TextureFormat formatFor(const Image &image){
+			const GLenum formats[] = {GL_RED, GL_RG, GL_RGB, GL_RGBA};
+			const GLenum internal8[] = {GL_R8, GL_RG8, GL_RGB8, GL_RGBA8};
+			const GLenum internal16[] = {GL_R16, GL_RG16, GL_RGB16, GL_RGBA16};
+			int i = std::min(std::max(image.channels, 1), 4) - 1;
+			if(image.bytesPerChannel == 2){
+				return TextureFormat{internal16[i], formats[i], GL_UNSIGNED_SHORT};
+			}
+			return TextureFormat{internal8[i], formats[i], GL_UNSIGNED_BYTE};
+		}
+
+		//Gray and gray+alpha images come through as red and red+green.
+		//Swizzle them so shaders still see gray.
+		static void setSwizzle(const Image &image){
+			if(image.channels == 1){
+				const GLint swizzle[] = {GL_RED, GL_RED, GL_RED, GL_ONE};
+				glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+			} else if(image.channels == 2){
+				const GLint swizzle[] = {GL_RED, GL_RED, GL_RED, GL_GREEN};
+				glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+			}
+		}
+
+		//The biggest GL_UNPACK_ALIGNMENT our rows actually line up to.
+		//GL pads rows out to this, so it has to be right or the image comes out sheared.
+		static int unpackAlignment(size_t rowBytes){
+			if(rowBytes % 8 == 0) return 8;
+			if(rowBytes % 4 == 0) return 4;
+			if(rowBytes % 2 == 0) return 2;
+			return 1;
+		}
+
+		//Makes a new texture with our usual wrapping/filtering and leaves it bound
+		static unsigned int createTexture(){
+			unsigned int texture;
+			glGenTextures(1, &texture);
+			glBindTexture(GL_TEXTURE_2D, texture);
+
+			//Set texture wrapping/filtering options
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR); //MAG for magnification
+			return texture;
+		}
+
+		//Must be called on the thread with the GL context
+		static unsigned int upload(const Image &image){
+			unsigned int texture = createTexture();
+			if(image.data){
+				TextureFormat format = formatFor(image);
+				setSwizzle(image);
+				glPixelStorei(GL_UNPACK_ALIGNMENT, unpackAlignment(image.rowBytes()));
+				if(!image.mips.empty()){
+					uploadMipChain(image, format);
+					glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+					//Only worth making them if they get sampled
+					glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+					return texture;
+				}
+				//No mips, so just the one level. GL_LINEAR never looks past it.
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+				glTexImage2D(GL_TEXTURE_2D, //Texture target
+						0, //Mipmap level. Only level 0, see above.
+						format.internalFormat, //Texture storage format
+						image.width, //We got the width and height values from the image
+						image.height,//when we loaded it, so we're using those.
+						0, //Always 0. Legacy thingy.
+						format.format, //Source image format
+						format.type, //Source image data type
+						image.data); //The actual image data
+				glPixelStorei(GL_UNPACK_ALIGNMENT, 4); //Back to GL's default
+			}
+			return texture;
+		}
+
+	private:
+		static bool immutableStorageSupported(){
+			return epoxy_gl_version() >= 42 || epoxy_has_gl_extension("GL_ARB_texture_storage");
+		}
+
+		//Upload level 0 and every level in image.mips to the bound texture
+		static void uploadMipChain(const Image &image, const TextureFormat &format){
+			int levels = image.mips.size() + 1;
+			bool immutable = immutableStorageSupported();
+			if(immutable){
+				//Allocates every level up front, and promises the driver they'll never change size
+				glTexStorage2D(GL_TEXTURE_2D, levels, format.internalFormat, image.width, image.height);
+				glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, image.width, image.height, format.format, format.type, image.data);
+			} else {
+				glTexImage2D(GL_TEXTURE_2D, 0, format.internalFormat, image.width, image.height, 0, format.format, format.type, image.data);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+			}
+			for(int i = 1; i < levels; i++){
+				const MipLevel &level = image.mips[i - 1];
+				glPixelStorei(GL_UNPACK_ALIGNMENT, unpackAlignment((size_t)level.width * image.channels * image.bytesPerChannel));
+				if(immutable){
+					glTexSubImage2D(GL_TEXTURE_2D, i, 0, 0, level.width, level.height, format.format, format.type, level.data.data());
+				} else {
+					glTexImage2D(GL_TEXTURE_2D, i, format.internalFormat, level.width, level.height, 0, format.format, format.type, level.data.data());
+				}
+			}
+		}
+};
+
+#endif
@@ -0,0 +1,209 @@
+#ifndef TEXTURESTREAMER_H
+#define TEXTURESTREAMER_H
+
+#include <epoxy/gl.h>
+#include <epoxy/glx.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <string>
+#include <vector>
+
+#include "textureloader.h"
+
+//Loads textures in the background without ever stalling the render loop.
+//Images are decoded on another thread, then copied a slice at a time into a ring
+//of pixel buffer memory that the driver can DMA from while we keep rendering.
+//Until a texture has fully arrived, texture() hands back a placeholder instead.
+//
+//Call update() once per frame on the thread with the GL context.
+class TextureStreamer{
+	public:
+		unsigned int placeholder;
+
+		//ringSize: bytes of staging memory shared by every upload in flight
+		//bytesPerFrame: how much to push through it each update(), to bound the per-frame cost
+		TextureStreamer(size_t ringSize = 32 << 20, size_t bytesPerFrame = 8 << 20)
+			: ringSize(ringSize), bytesPerFrame(bytesPerFrame), ringHead(0){
+			//A flat grey 1x1 texture to draw with while the real thing loads
+			const unsigned char grey[] = {128, 128, 128, 255};
+			placeholder = TextureLoader::createTexture();
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+
+			glGenBuffers(1, &PBO);
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, PBO);
+			//With ARB_buffer_storage we can map the whole ring once and leave it mapped for good.
+			//Otherwise (plain 3.3) we map just the slice we're about to fill, unsynchronized,
+			//since the fences already tell us nobody is still reading it.
+			persistent = epoxy_gl_version() >= 44 || epoxy_has_gl_extension("GL_ARB_buffer_storage");
+			if(persistent){
+				GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+				glBufferStorage(GL_PIXEL_UNPACK_BUFFER, ringSize, NULL, flags);
+				ringMemory = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, ringSize, flags);
+			} else {
+				glBufferData(GL_PIXEL_UNPACK_BUFFER, ringSize, NULL, GL_STREAM_DRAW);
+				ringMemory = NULL;
+			}
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		}
+
+		~TextureStreamer(){
+			for(Region &region : inFlight){
+				glDeleteSync(region.fence);
+			}
+			for(Entry &entry : entries){
+				if(entry.image.data) entry.image.release();
+			}
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, PBO);
+			if(persistent) glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			glDeleteBuffers(1, &PBO);
+			glDeleteTextures(1, &placeholder);
+		}
+
+		//Start loading a texture. Returns a handle for texture().
+		int request(const std::string &path){
+			entries.push_back(Entry());
+			Entry &entry = entries.back();
+			entry.decoding = std::async(std::launch::async, TextureLoader::decode, path);
+			entry.texture = 0;
+			entry.image.data = NULL;
+			entry.rowsUploaded = 0;
+			entry.resident = false;
+			return entries.size() - 1;
+		}
+
+		//The texture to bind for this handle right now
+		unsigned int texture(int handle) const{
+			return entries[handle].resident ? entries[handle].texture : placeholder;
+		}
+
+		void update(){
+			retireRegions();
+
+			for(Entry &entry : entries){
+				//Still decoding? Check back next frame.
+				if(!entry.decoding.valid()) continue;
+				if(entry.decoding.wait_for(std::chrono::seconds(0)) != std::future_status::ready) continue;
+				entry.image = entry.decoding.get();
+				if(!entry.image.data) continue; //Failed to load, so it keeps the placeholder
+				entry.texture = TextureLoader::createTexture();
+				entry.format = TextureLoader::formatFor(entry.image);
+				TextureLoader::setSwizzle(entry.image);
+				//Just allocate for now; the pixels come in slices. (This has to happen
+				//with no PBO bound, or GL would take NULL as an offset into it.)
+				//One level only, like TextureLoader without CPU mips.
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+				glTexImage2D(GL_TEXTURE_2D, 0, entry.format.internalFormat, entry.image.width, entry.image.height, 0,
+					entry.format.format, entry.format.type, NULL);
+			}
+
+			size_t budget = bytesPerFrame;
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, PBO);
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 1); //We pack rows tightly into the ring
+			for(Entry &entry : entries){
+				if(entry.resident || !entry.image.data) continue;
+				if(!uploadSlice(entry, budget)) break; //Out of budget or ring space until next frame
+			}
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		}
+
+	private:
+		struct Entry{
+			std::future<Image> decoding;
+			Image image;
+			TextureFormat format;
+			unsigned int texture;
+			int rowsUploaded;
+			bool resident;
+		};
+		//A slice of the ring the GPU might still be reading from
+		struct Region{
+			size_t offset;
+			size_t size;
+			GLsync fence;
+		};
+
+		size_t ringSize;
+		size_t bytesPerFrame;
+		unsigned int PBO;
+		bool persistent;
+		unsigned char* ringMemory; //The persistent mapping, if we have one
+		size_t ringHead; //Where the next allocation starts
+		std::deque<Region> inFlight; //Oldest first
+		std::deque<Entry> entries; //A deque so handing out references doesn't get invalidated by push_back
+
+		//Copy as many rows of this image as we can afford into the ring and kick off their upload.
+		//Returns false when we've run out of budget or ring space for this frame.
+		bool uploadSlice(Entry &entry, size_t &budget){
+			Image &image = entry.image;
+			size_t rowBytes = image.rowBytes();
+			while(entry.rowsUploaded < image.height){
+				size_t rowsLeft = image.height - entry.rowsUploaded;
+				size_t rows = std::min(rowsLeft, std::min(budget, ringSize) / rowBytes);
+				size_t offset;
+				if(rows == 0 || !allocate(rows * rowBytes, offset)) return false;
+
+				const unsigned char* source = image.data + entry.rowsUploaded * rowBytes;
+				if(persistent){
+					memcpy(ringMemory + offset, source, rows * rowBytes);
+				} else {
+					void* slice = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, offset, rows * rowBytes,
+						GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+					memcpy(slice, source, rows * rowBytes);
+					glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+				}
+				glBindTexture(GL_TEXTURE_2D, entry.texture);
+				//With a PBO bound, the "pixels" argument is an offset into it
+				glTexSubImage2D(GL_TEXTURE_2D, 0, 0, entry.rowsUploaded, image.width, rows,
+					entry.format.format, entry.format.type, (void*)offset);
+				inFlight.push_back(Region{offset, rows * rowBytes, glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0)});
+
+				entry.rowsUploaded += rows;
+				budget -= rows * rowBytes;
+			}
+			entry.image.release(); //It's all in the ring or on the GPU now
+			entry.resident = true;
+			return true;
+		}
+
+		//Free up every region the GPU has finished reading, oldest first
+		void retireRegions(){
+			while(!inFlight.empty()){
+				GLenum status = glClientWaitSync(inFlight.front().fence, 0, 0);
+				if(status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) break;
+				glDeleteSync(inFlight.front().fence);
+				inFlight.pop_front();
+			}
+		}
+
+		//Find size contiguous bytes of the ring that aren't in flight
+		bool allocate(size_t size, size_t &offset){
+			size = (size + 63) & ~(size_t)63; //Keep slices cache-line aligned
+			if(inFlight.empty()){
+				ringHead = 0;
+				if(size > ringSize) return false;
+				offset = 0;
+			} else {
+				size_t tail = inFlight.front().offset;
+				if(ringHead > tail){
+					//Free space is [head, end) and [0, tail)
+					if(ringSize - ringHead >= size) offset = ringHead;
+					else if(tail >= size) offset = 0;
+					else return false;
+				} else {
+					//We've wrapped around, so free space is [head, tail)
+					if(tail - ringHead >= size) offset = ringHead;
+					else return false;
+				}
+			}
+			ringHead = offset + size;
+			return true;
+		}
+};
+
+#endif
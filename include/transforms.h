@@ -0,0 +1,239 @@
+#ifndef TRANSFORMS_H
+#define TRANSFORMS_H
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "jobsystem.h"
+
+//Position, rotation and scale for a lot of objects, stored as one array per
+//component (structure of arrays) rather than one struct per object, so we can
+//turn them into model matrices 4 objects at a time with SSE (or one at a time
+//without it).
+//Only objects that have changed since the last update() get recomputed.
+//
+//The matrices come out the same as glm::translate(position) * glm::rotate(angle, axis) * glm::scale(scale).
+class TransformStore{
+	public:
+		std::vector<float> posX, posY, posZ;
+		std::vector<float> axisX, axisY, axisZ; //Rotation axis, normalized
+		std::vector<float> angle; //Radians
+		std::vector<float> scale; //Uniform scale
+		std::vector<glm::mat4> matrices; //The model matrices, as of the last update()
+
+		TransformStore() : count(0), anyDirty(false){}
+
+		size_t size() const{ return count; }
+
+		size_t add(const glm::vec3 &position, const glm::vec3 &axis, float angleRadians, float uniformScale = 1.0f){
+			size_t i = count;
+			resize(count + 1);
+			setPosition(i, position);
+			setRotation(i, axis, angleRadians);
+			setScale(i, uniformScale);
+			return i;
+		}
+
+		void setPosition(size_t i, const glm::vec3 &position){
+			posX[i] = position.x;
+			posY[i] = position.y;
+			posZ[i] = position.z;
+			markDirty(i);
+		}
+		void setRotation(size_t i, const glm::vec3 &axis, float angleRadians){
+			glm::vec3 normalized = glm::normalize(axis);
+			axisX[i] = normalized.x;
+			axisY[i] = normalized.y;
+			axisZ[i] = normalized.z;
+			angle[i] = angleRadians;
+			markDirty(i);
+		}
+		void setAngle(size_t i, float angleRadians){
+			angle[i] = angleRadians;
+			markDirty(i);
+		}
+		void setScale(size_t i, float uniformScale){
+			scale[i] = uniformScale;
+			markDirty(i);
+		}
+
+		void markDirty(size_t i){
+			dirty[i] = 1;
+			anyDirty = true;
+		}
+
+		//Recompute the matrices of everything that changed, split across the job system if given one.
+		//Returns false if nothing had, so callers can skip re-uploading.
+		bool update(JobSystem* jobs = NULL){
+			if(!anyDirty) return false;
+			size_t blocks = (count + 3) / 4;
+			if(jobs){
+				//Blocks don't share anything, so they can go to different threads in any order
+				jobs->parallelFor(blocks, 1024, [this](size_t begin, size_t end){
+					updateBlocks(begin, end);
+				});
+			} else {
+				updateBlocks(0, blocks);
+			}
+			anyDirty = false;
+			return true;
+		}
+
+	private:
+		size_t count;
+		std::vector<uint8_t> dirty;
+		bool anyDirty;
+
+		//Arrays are kept padded to a multiple of 4 so the kernel never needs a scalar tail
+		void resize(size_t newCount){
+			count = newCount;
+			size_t padded = (newCount + 3) & ~(size_t)3;
+			posX.resize(padded, 0.0f);
+			posY.resize(padded, 0.0f);
+			posZ.resize(padded, 0.0f);
+			axisX.resize(padded, 0.0f);
+			axisY.resize(padded, 1.0f);
+			axisZ.resize(padded, 0.0f);
+			angle.resize(padded, 0.0f);
+			scale.resize(padded, 1.0f);
+			dirty.resize(padded, 0);
+			matrices.resize(padded);
+		}
+
+		//Blocks of 4 objects, from block first up to (not including) last
+		void updateBlocks(size_t first, size_t last){
+			for(size_t block = first; block < last; block++){
+				size_t i = block * 4;
+				//Dirty flags are bytes, so this checks a block of 4 in one go
+				uint32_t blockDirty;
+				memcpy(&blockDirty, &dirty[i], sizeof(blockDirty));
+				if(!blockDirty) continue;
+				computeBlock(i);
+				memset(&dirty[i], 0, 4);
+			}
+		}
+
+#if defined(__SSE2__)
+		//sin and cos of 4 angles at once. Wraps into [-pi, pi], folds that into
+		//[-pi/2, pi/2], then uses Taylor series out to x^11 / x^12 (good to ~1e-7 there).
+		static void sinCos(__m128 x, __m128 &sinOut, __m128 &cosOut){
+			const __m128 twoPi = _mm_set1_ps(6.28318531f);
+			const __m128 pi = _mm_set1_ps(3.14159265f);
+			const __m128 halfPi = _mm_set1_ps(1.57079633f);
+			const __m128 signBit = _mm_set1_ps(-0.0f);
+
+			//x -= 2pi * round(x / 2pi)
+			__m128 turns = _mm_cvtepi32_ps(_mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(0.159154943f))));
+			x = _mm_sub_ps(x, _mm_mul_ps(turns, twoPi));
+
+			//sin(x) = sin(pi - x) and cos(x) = -cos(pi - x), with the sign of pi following x
+			__m128 xSign = _mm_and_ps(x, signBit);
+			__m128 fold = _mm_cmpgt_ps(_mm_andnot_ps(signBit, x), halfPi);
+			__m128 folded = _mm_sub_ps(_mm_or_ps(pi, xSign), x);
+			x = _mm_or_ps(_mm_and_ps(fold, folded), _mm_andnot_ps(fold, x));
+
+			__m128 x2 = _mm_mul_ps(x, x);
+			//Horner's rule on 1 - x^2/3! + x^4/5! - ...
+			__m128 s = _mm_set1_ps(-2.50521084e-8f);
+			s = _mm_add_ps(_mm_mul_ps(s, x2), _mm_set1_ps(2.75573192e-6f));
+			s = _mm_add_ps(_mm_mul_ps(s, x2), _mm_set1_ps(-1.98412698e-4f));
+			s = _mm_add_ps(_mm_mul_ps(s, x2), _mm_set1_ps(8.33333333e-3f));
+			s = _mm_add_ps(_mm_mul_ps(s, x2), _mm_set1_ps(-1.66666667e-1f));
+			s = _mm_add_ps(_mm_mul_ps(s, x2), _mm_set1_ps(1.0f));
+			sinOut = _mm_mul_ps(s, x);
+
+			__m128 c = _mm_set1_ps(2.08767570e-9f);
+			c = _mm_add_ps(_mm_mul_ps(c, x2), _mm_set1_ps(-2.75573192e-7f));
+			c = _mm_add_ps(_mm_mul_ps(c, x2), _mm_set1_ps(2.48015873e-5f));
+			c = _mm_add_ps(_mm_mul_ps(c, x2), _mm_set1_ps(-1.38888889e-3f));
+			c = _mm_add_ps(_mm_mul_ps(c, x2), _mm_set1_ps(4.16666667e-2f));
+			c = _mm_add_ps(_mm_mul_ps(c, x2), _mm_set1_ps(-0.5f));
+			c = _mm_add_ps(_mm_mul_ps(c, x2), _mm_set1_ps(1.0f));
+			cosOut = _mm_xor_ps(c, _mm_and_ps(fold, signBit));
+		}
+
+		//Model matrices for objects i to i+3
+		void computeBlock(size_t i){
+			const __m128 one = _mm_set1_ps(1.0f);
+			const __m128 two = _mm_set1_ps(2.0f);
+
+			//Axis-angle to quaternion: (axis * sin(angle/2), cos(angle/2))
+			__m128 halfSin, halfCos;
+			sinCos(_mm_mul_ps(_mm_loadu_ps(&angle[i]), _mm_set1_ps(0.5f)), halfSin, halfCos);
+			__m128 qx = _mm_mul_ps(_mm_loadu_ps(&axisX[i]), halfSin);
+			__m128 qy = _mm_mul_ps(_mm_loadu_ps(&axisY[i]), halfSin);
+			__m128 qz = _mm_mul_ps(_mm_loadu_ps(&axisZ[i]), halfSin);
+			__m128 qw = halfCos;
+
+			__m128 xx = _mm_mul_ps(qx, qx), yy = _mm_mul_ps(qy, qy), zz = _mm_mul_ps(qz, qz);
+			__m128 xy = _mm_mul_ps(qx, qy), xz = _mm_mul_ps(qx, qz), yz = _mm_mul_ps(qy, qz);
+			__m128 wx = _mm_mul_ps(qw, qx), wy = _mm_mul_ps(qw, qy), wz = _mm_mul_ps(qw, qz);
+			__m128 s = _mm_loadu_ps(&scale[i]);
+
+			//Quaternion to rotation matrix, one column at a time, scaled
+			__m128 columns[3][3] = {
+				{
+					_mm_mul_ps(s, _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz)))),
+					_mm_mul_ps(s, _mm_mul_ps(two, _mm_add_ps(xy, wz))),
+					_mm_mul_ps(s, _mm_mul_ps(two, _mm_sub_ps(xz, wy)))
+				},
+				{
+					_mm_mul_ps(s, _mm_mul_ps(two, _mm_sub_ps(xy, wz))),
+					_mm_mul_ps(s, _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz)))),
+					_mm_mul_ps(s, _mm_mul_ps(two, _mm_add_ps(yz, wx)))
+				},
+				{
+					_mm_mul_ps(s, _mm_mul_ps(two, _mm_add_ps(xz, wy))),
+					_mm_mul_ps(s, _mm_mul_ps(two, _mm_sub_ps(yz, wx))),
+					_mm_mul_ps(s, _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))))
+				}
+			};
+
+			//Each register holds one element for 4 objects, but each matrix wants one column
+			//per object. A 4x4 transpose per column swaps those around.
+			float* out = &matrices[i][0][0];
+			for(int col = 0; col < 3; col++){
+				__m128 r0 = columns[col][0], r1 = columns[col][1], r2 = columns[col][2], r3 = _mm_setzero_ps();
+				_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+				_mm_storeu_ps(out + 0 * 16 + col * 4, r0);
+				_mm_storeu_ps(out + 1 * 16 + col * 4, r1);
+				_mm_storeu_ps(out + 2 * 16 + col * 4, r2);
+				_mm_storeu_ps(out + 3 * 16 + col * 4, r3);
+			}
+			__m128 r0 = _mm_loadu_ps(&posX[i]), r1 = _mm_loadu_ps(&posY[i]), r2 = _mm_loadu_ps(&posZ[i]), r3 = one;
+			_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+			_mm_storeu_ps(out + 0 * 16 + 12, r0);
+			_mm_storeu_ps(out + 1 * 16 + 12, r1);
+			_mm_storeu_ps(out + 2 * 16 + 12, r2);
+			_mm_storeu_ps(out + 3 * 16 + 12, r3);
+		}
+#else
+		//Model matrices for objects i to i+3, the same way as above but one at a time
+		void computeBlock(size_t i){
+			for(size_t j = i; j < i + 4; j++){
+				float halfSin = std::sin(angle[j] * 0.5f);
+				float qx = axisX[j] * halfSin, qy = axisY[j] * halfSin, qz = axisZ[j] * halfSin;
+				float qw = std::cos(angle[j] * 0.5f);
+				float xx = qx * qx, yy = qy * qy, zz = qz * qz;
+				float xy = qx * qy, xz = qx * qz, yz = qy * qz;
+				float wx = qw * qx, wy = qw * qy, wz = qw * qz;
+				float s = scale[j];
+				glm::mat4 &m = matrices[j];
+				m[0] = glm::vec4(s * (1.0f - 2.0f * (yy + zz)), s * 2.0f * (xy + wz), s * 2.0f * (xz - wy), 0.0f);
+				m[1] = glm::vec4(s * 2.0f * (xy - wz), s * (1.0f - 2.0f * (xx + zz)), s * 2.0f * (yz + wx), 0.0f);
+				m[2] = glm::vec4(s * 2.0f * (xz + wy), s * 2.0f * (yz - wx), s * (1.0f - 2.0f * (xx + yy)), 0.0f);
+				m[3] = glm::vec4(posX[j], posY[j], posZ[j], 1.0f);
+			}
+		}
+#endif
+};
+
+#endif
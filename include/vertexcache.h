@@ -0,0 +1,178 @@
+#ifndef VERTEXCACHE_H
+#define VERTEXCACHE_H
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+//Reorders triangles so the GPU's post-transform cache gets more hits, meaning fewer
+//vertex shader runs for the same mesh. This is Tom Forsyth's "linear-speed vertex cache
+//optimisation": greedily pick the next triangle whose vertices are either already in
+//a simulated cache or have few triangles left to use them (so they can be finished off).
+//
+//It doesn't depend on the real cache size being right, which is good, because nobody tells us it.
+class VertexCacheOptimizer{
+	public:
+		static const int CACHE_SIZE = 32;
+
+		//Reorders the triangles in indices (3 per triangle) in place
+		static void optimize(std::vector<uint32_t> &indices, size_t vertexCount){
+			size_t triangleCount = indices.size() / 3;
+			if(triangleCount == 0) return;
+
+			//Which triangles use each vertex, as one flat list with an offset per vertex
+			std::vector<uint32_t> remaining(vertexCount, 0); //Triangles not yet emitted, per vertex
+			for(uint32_t index : indices){
+				remaining[index]++;
+			}
+			std::vector<uint32_t> firstTriangle(vertexCount + 1, 0);
+			for(size_t v = 0; v < vertexCount; v++){
+				firstTriangle[v + 1] = firstTriangle[v] + remaining[v];
+			}
+			std::vector<uint32_t> triangles(indices.size());
+			std::vector<uint32_t> filled(firstTriangle.begin(), firstTriangle.end() - 1);
+			for(size_t t = 0; t < triangleCount; t++){
+				for(int corner = 0; corner < 3; corner++){
+					triangles[filled[indices[t * 3 + corner]]++] = t;
+				}
+			}
+
+			std::vector<int> cachePosition(vertexCount, -1);
+			std::vector<float> vertexScores(vertexCount);
+			for(size_t v = 0; v < vertexCount; v++){
+				vertexScores[v] = vertexScore(-1, remaining[v]);
+			}
+			std::vector<float> triangleScores(triangleCount);
+			std::vector<bool> emitted(triangleCount, false);
+			for(size_t t = 0; t < triangleCount; t++){
+				triangleScores[t] = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+			}
+
+			std::vector<uint32_t> output;
+			output.reserve(indices.size());
+			//Vertices in the simulated cache, most recent first. The extra 3 hold whatever
+			//gets pushed out by the newest triangle, so their scores get updated too.
+			uint32_t cache[CACHE_SIZE + 3];
+			int cacheCount = 0;
+			long best = -1;
+			size_t scanFrom = 0; //Every triangle before this one has been emitted
+
+			while(output.size() < indices.size()){
+				if(best < 0){
+					//Nothing left that touches the cache, so start on the next triangle in the
+					//original order. (Searching the whole mesh for the best one would make
+					//this quadratic for meshes made of lots of separate pieces.)
+					while(emitted[scanFrom]) scanFrom++;
+					best = scanFrom;
+				}
+
+				const uint32_t* corners = &indices[best * 3];
+				emitted[best] = true;
+				uint32_t newCache[CACHE_SIZE + 3];
+				int newCount = 0;
+				for(int corner = 0; corner < 3; corner++){
+					uint32_t v = corners[corner];
+					output.push_back(v);
+					//(Degenerate triangles can use a vertex twice, but it only goes in the cache once)
+					bool repeated = (corner > 0 && v == corners[0]) || (corner > 1 && v == corners[1]);
+					if(!repeated) newCache[newCount++] = v;
+					//This triangle doesn't need v any more
+					uint32_t* begin = &triangles[firstTriangle[v]];
+					uint32_t* end = begin + remaining[v];
+					for(uint32_t* t = begin; t < end; t++){
+						if(*t == (uint32_t)best){
+							*t = *(end - 1);
+							break;
+						}
+					}
+					remaining[v]--;
+				}
+				//Everything that was in the cache before moves back behind this triangle's vertices
+				for(int i = 0; i < cacheCount; i++){
+					uint32_t v = cache[i];
+					if(v != corners[0] && v != corners[1] && v != corners[2]){
+						newCache[newCount++] = v;
+					}
+				}
+
+				//Rescore everything that moved, and the triangles that use it
+				best = -1;
+				float bestScore = -1.0f;
+				for(int i = 0; i < newCount; i++){
+					uint32_t v = newCache[i];
+					cachePosition[v] = i < CACHE_SIZE ? i : -1;
+					float newScore = vertexScore(cachePosition[v], remaining[v]);
+					float change = newScore - vertexScores[v];
+					vertexScores[v] = newScore;
+					for(uint32_t j = 0; j < remaining[v]; j++){
+						uint32_t t = triangles[firstTriangle[v] + j];
+						triangleScores[t] += change;
+						if(triangleScores[t] > bestScore){
+							bestScore = triangleScores[t];
+							best = t;
+						}
+					}
+				}
+				cacheCount = newCount < CACHE_SIZE ? newCount : CACHE_SIZE;
+				for(int i = 0; i < cacheCount; i++){
+					cache[i] = newCache[i];
+				}
+			}
+			indices.swap(output);
+		}
+
+		//Renumbers vertices in the order the indices first use them, so the vertex
+		//fetches walk through memory forwards too. Returns the new position of each old vertex.
+		static std::vector<uint32_t> fetchOrder(std::vector<uint32_t> &indices, size_t vertexCount){
+			std::vector<uint32_t> remap(vertexCount, UINT32_MAX);
+			uint32_t next = 0;
+			for(uint32_t &index : indices){
+				if(remap[index] == UINT32_MAX){
+					remap[index] = next++;
+				}
+				index = remap[index];
+			}
+			//Anything no triangle uses goes on the end
+			for(uint32_t &position : remap){
+				if(position == UINT32_MAX) position = next++;
+			}
+			return remap;
+		}
+
+		//Average cache misses per triangle through a FIFO cache of the given size.
+		//1.0 or a bit under is about as good as it gets; 3.0 means the cache never hits.
+		static float acmr(const std::vector<uint32_t> &indices, size_t vertexCount, int cacheSize = 16){
+			if(indices.empty()) return 0.0f;
+			std::vector<long> insertedAt(vertexCount, -1000000000L);
+			long misses = 0;
+			for(uint32_t index : indices){
+				if(misses - insertedAt[index] >= cacheSize){
+					insertedAt[index] = misses;
+					misses++;
+				}
+			}
+			return (float)misses / (indices.size() / 3);
+		}
+
+	private:
+		//How much we'd like to use a vertex next: more if it's near the front of the
+		//cache, and more if it only has a few triangles left.
+		static float vertexScore(int cachePosition, uint32_t remainingTriangles){
+			if(remainingTriangles == 0) return -1.0f; //Nothing left to draw with it
+			float score = 0.0f;
+			if(cachePosition >= 0){
+				if(cachePosition < 3){
+					//It's in the triangle we just drew. Using it straight away would make
+					//for strips, which don't actually use the cache that well.
+					score = 0.75f;
+				} else {
+					float scale = 1.0f / (CACHE_SIZE - 3);
+					score = std::pow(1.0f - (cachePosition - 3) * scale, 1.5f);
+				}
+			}
+			score += 2.0f / std::sqrt((float)remainingTriangles);
+			return score;
+		}
+};
+
+#endif
@@ -1,5 +1,15 @@
+#include <algorithm>
 #include <iostream>
 #include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include <epoxy/gl.h>
 #include <epoxy/glx.h>
@@ -8,37 +18,164 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
-#include "stb_image.h"
-
 #include "shaderprog.h"
 #include "cube.h"
+#include "geometryarena.h"
+#include "drawcommands.h"
+#include "softrasterizer.h"
+#include "softpresenter.h"
+#include "mesh.h"
+#include "framebuffer.h"
+#include "benchmark.h"
+#include "textureloader.h"
+#include "texturestreamer.h"
+#include "camera.h"
+#include "camerauniforms.h"
+#include "frustum.h"
+#include "transforms.h"
+#include "jobsystem.h"
+#include "framering.h"
+#include "pixelreadback.h"
+#include "pngwriter.h"
+#include "imagecompare.h"
+#include "framecapture.h"
+#include "filewatcher.h"
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void processInput(GLFWwindow* window);
 GLFWwindow* setupWindow(int x, int y, int width, int height, const char* title);
-unsigned int loadTextures(const char* filepath);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
+void scriptedCamera(float time);
+bool checkGolden(const std::string &path, const unsigned char* pixels, int width, int height,
+		bool update, double minPSNR, int maxError);
 
 const int WIDTH = 2560;
 const int HEIGHT = 1440;
 
 //Camera
-glm::vec3 cameraPos = glm::vec3(0.0f, 0.0f, 3.0f);
-glm::vec3 cameraFront = glm::vec3(0.0f, 0.0f, -1.0f);
-glm::vec3 cameraUp = glm::vec3(0.0f, 1.0f, 0.0f);
-float pitch;
-float yaw = -90.0f; //Default to the camera pointing toward the negative Z axis
+Camera camera(glm::vec3(0.0f, 0.0f, 3.0f), -90.0f, 0.0f); //Default to the camera pointing toward the negative Z axis
 bool firstMouse = true; //Flag to detect when the cursor first enters the window
 float mouseLastX = WIDTH/2, mouseLastY = HEIGHT/2;
 
 float dTime = 0.0f;
 float lastFrame = 0.0f;
 
-int main(int argv, char* argc[]){
+int main(int argc, char* argv[]){
+	//Draw every cube with a single instanced draw call unless told otherwise
+	bool useInstancing = true;
+	//Skip drawing cubes that are entirely off screen
+	bool useCulling = true;
+	//Keep the cubes turning, so their transforms change every frame
+	bool spin = false;
+	//Headless: render offscreen with a scripted camera, then print timing stats and exit
+	bool headless = false;
+	int frameLimit = 0; //0 means keep going until the window is closed
+	int cubeCount = 10;
+	//Benchmarking: record frame timings and report percentiles at the end
+	bool bench = false;
+	std::string benchCSV, benchJSON;
+	//Load textures in the background and draw with a placeholder until they arrive
+	bool streamTextures = false;
+	//Build mipmaps ourselves on the decode threads rather than with glGenerateMipmap
+	bool cpuMipmaps = false;
+	//Threads for per-frame CPU work (transforms, culling...), counting the main thread. 0 means one per core.
+	int threadCount = 0;
+	//Draw a mesh loaded from this file (.obj or .ply) in place of each cube
+	std::string meshPath;
+	//Store vertices as 16-bit integers and half floats rather than 32-bit floats
+	bool quantize = false;
+	//With --mesh, draw the mesh for every other cube rather than all of them
+	bool mixed = false;
+	//Draw with our own CPU rasterizer rather than through GL (which only shows the result)
+	bool software = false;
+	//Regression check: compare the last frame against this image, which has to exist already
+	std::string goldenPath;
+	bool updateGolden = false; //Write this run's frame as the golden image instead of checking against it
+	double goldenMinPSNR = 40.0;
+	int goldenMaxError = 255; //255 allows any single channel to be off by anything
+	//Save every frame, as numbered PNGs starting with this prefix or as raw frames piped to this command
+	std::string capturePrefix, captureCommand;
+	int captureLevel = 1; //zlib level for captured PNGs
+	//Rebuild the shaders whenever their files are saved
+	bool watchShaders = false;
+	for(int i = 1; i < argc; i++){
+		if(strcmp(argv[i], "--no-instancing") == 0){
+			useInstancing = false;
+		} else if(strcmp(argv[i], "--no-culling") == 0){
+			useCulling = false;
+		} else if(strcmp(argv[i], "--spin") == 0){
+			spin = true;
+		} else if(strcmp(argv[i], "--headless") == 0){
+			headless = true;
+		} else if(strcmp(argv[i], "--frames") == 0 && i + 1 < argc){
+			frameLimit = atoi(argv[++i]);
+		} else if(strcmp(argv[i], "--cubes") == 0 && i + 1 < argc){
+			cubeCount = std::max(1, atoi(argv[++i]));
+		} else if(strcmp(argv[i], "--mesh") == 0 && i + 1 < argc){
+			meshPath = argv[++i];
+		} else if(strcmp(argv[i], "--quantize") == 0){
+			quantize = true;
+		} else if(strcmp(argv[i], "--mixed") == 0){
+			mixed = true;
+		} else if(strcmp(argv[i], "--software") == 0){
+			software = true;
+		} else if(strcmp(argv[i], "--golden") == 0 && i + 1 < argc){
+			goldenPath = argv[++i];
+		} else if(strcmp(argv[i], "--update-golden") == 0){
+			updateGolden = true;
+		} else if(strcmp(argv[i], "--golden-psnr") == 0 && i + 1 < argc){
+			goldenMinPSNR = atof(argv[++i]);
+		} else if(strcmp(argv[i], "--golden-max-error") == 0 && i + 1 < argc){
+			goldenMaxError = atoi(argv[++i]);
+		} else if(strcmp(argv[i], "--capture") == 0 && i + 1 < argc){
+			capturePrefix = argv[++i];
+		} else if(strcmp(argv[i], "--capture-pipe") == 0 && i + 1 < argc){
+			captureCommand = argv[++i];
+		} else if(strcmp(argv[i], "--capture-level") == 0 && i + 1 < argc){
+			captureLevel = std::min(9, std::max(0, atoi(argv[++i])));
+		} else if(strcmp(argv[i], "--watch-shaders") == 0){
+			watchShaders = true;
+		} else if(strcmp(argv[i], "--threads") == 0 && i + 1 < argc){
+			threadCount = std::max(0, atoi(argv[++i]));
+		} else if(strcmp(argv[i], "--stream-textures") == 0){
+			streamTextures = true;
+		} else if(strcmp(argv[i], "--cpu-mipmaps") == 0){
+			cpuMipmaps = true;
+		} else if(strcmp(argv[i], "--bench") == 0){
+			bench = true;
+		} else if(strcmp(argv[i], "--bench-csv") == 0 && i + 1 < argc){
+			benchCSV = argv[++i];
+		} else if(strcmp(argv[i], "--bench-json") == 0 && i + 1 < argc){
+			benchJSON = argv[++i];
+		} else {
+			std::cout << "Unknown argument: " << argv[i] << std::endl;
+		}
+	}
+	//Only the headless frames come out the same every run
+	if(!goldenPath.empty()){
+		headless = true;
+	}
+	if(headless && frameLimit == 0){
+		frameLimit = 600;
+	}
+	if(software && quantize){
+		std::cout << "WARNING: The software rasterizer only draws float vertices, ignoring --quantize" << std::endl;
+		quantize = false;
+	}
+	if(streamTextures && cpuMipmaps){
+		std::cout << "WARNING: Streamed textures only get one level, ignoring --cpu-mipmaps" << std::endl;
+		cpuMipmaps = false;
+	}
+
 	glfwInit();
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	if(headless){
+		//We still need a window to get a context, but nobody has to see it.
+		//On GPU-less machines, LIBGL_ALWAYS_SOFTWARE=1 gets Mesa's llvmpipe.
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	}
 
 	//Set up viewport
 	GLFWwindow* window = setupWindow(0, 0, WIDTH, HEIGHT, "Magic Portal");
@@ -48,15 +185,93 @@ int main(int argv, char* argc[]){
 		return -1;
 	}
 
-	glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-	glfwSetCursorPosCallback(window, mouse_callback);
+	//Follow the real framebuffer size, which isn't always the window size (HiDPI, tiling WMs...)
+	int framebufferWidth, framebufferHeight;
+	glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+	camera.setViewport(framebufferWidth, framebufferHeight);
+	if(!headless){
+		glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+		glfwSetCursorPosCallback(window, mouse_callback);
+	}
 	
 	//Load textures
-	unsigned int texture0 = loadTextures("textures/bluegrad.png");
-	unsigned int texture1 = loadTextures("textures/mead_notebook_overlay.png");
+	std::vector<std::string> texturePaths = {
+		"textures/bluegrad.png",
+		"textures/mead_notebook_overlay.png"
+	};
+	std::vector<unsigned int> textures;
+	std::unique_ptr<TextureStreamer> textureStreamer;
+	std::vector<int> streamedTextures;
+	std::vector<Image> decodedImages;
+	if(streamTextures){
+		textureStreamer.reset(new TextureStreamer());
+		for(const std::string &path : texturePaths){
+			streamedTextures.push_back(textureStreamer->request(path));
+			textures.push_back(textureStreamer->placeholder);
+		}
+	} else {
+		TextureLoader textureLoader;
+		textureLoader.cpuMipmaps = cpuMipmaps;
+		textures = textureLoader.loadTextures(texturePaths, software ? &decodedImages : NULL);
+	}
+	//The software rasterizer needs its own copies, in plain memory. Reuse what the loader
+	//decoded if it kept them rather than decoding it all again.
+	std::vector<SoftTexture> softTextures(texturePaths.size());
+	if(software){
+		for(size_t i = 0; i < texturePaths.size(); i++){
+			Image image = i < decodedImages.size() ? decodedImages[i] : TextureLoader::decode(texturePaths[i]);
+			softTextures[i].load(image);
+			image.release();
+		}
+		decodedImages.clear();
+	}
+
+	//Worker threads for the per-frame CPU work. The main thread keeps the GL context to itself.
+	JobSystem jobs(threadCount > 0 ? threadCount - 1 : JobSystem::defaultWorkerCount());
+
+	//What gets drawn for each cube: the cube itself, or a mesh if we were given one
+	MeshData cubeData = Cube::meshData();
+	MeshBlobs objectData = cubeData.blobs();
+	MeshLoader meshLoader;
+	bool haveMesh = false;
+	if(!meshPath.empty() && meshLoader.load(meshPath)){
+		objectData = meshLoader.data();
+		haveMesh = true;
+	}
+	//Float vertices all go in one shared arena and get drawn from its one VAO. Quantized
+	//ones each need their own dequantization, so they keep a VAO of their own (and there's
+	//only ever one kind of object).
+	if(quantize && mixed){
+		std::cout << "WARNING: --mixed doesn't work with --quantize, ignoring it" << std::endl;
+	}
+	mixed = mixed && haveMesh && !quantize;
+	GeometryArena arena;
+	std::vector<GeometryRange> objectRanges;
+	std::vector<MeshBlobs> objectBlobs; //The same meshes in CPU memory, for the software rasterizer
+	std::unique_ptr<Mesh> mesh;
+	std::unique_ptr<Cube> cube;
+	if(quantize){
+		if(haveMesh) mesh.reset(new Mesh(objectData, true));
+		else cube.reset(new Cube(true));
+	} else {
+		if(mixed) objectBlobs.push_back(cubeData.blobs());
+		objectBlobs.push_back(objectData);
+		for(const MeshBlobs &blobs : objectBlobs){
+			objectRanges.push_back(arena.add(blobs));
+		}
+	}
+	//A mesh gets scaled down (or up) to take up about as much room as a cube
+	float meshScale = 1.0f;
+	if(haveMesh){
+		float extent = 0.0f;
+		for(int axis = 0; axis < 3; axis++){
+			extent = std::max(extent, objectData.bounds.max[axis] - objectData.bounds.min[axis]);
+		}
+		meshScale = extent > 0.0f ? 1.0f / extent : 1.0f;
+	}
 
 	//Make a whole bunch of cubes
-	glm::vec3 cubePositions[] ={
+	std::vector<glm::vec3> cubePositions ={
 		glm::vec3( 0.0f,  0.0f,  0.0f),
 		glm::vec3( 2.0f,  5.0f, -15.0f),
 		glm::vec3(-1.5f, -2.2f, -2.5f),
@@ -68,90 +283,367 @@ int main(int argv, char* argc[]){
 		glm::vec3( 1.5f,  0.2f, -1.5f),
 		glm::vec3(-1.3f,  1.0f, -1.5f)
 	};
-	Cube cube;
+	//Asked for more than that? Scatter the rest through a box that grows with the count
+	//so the density stays about the same. Fixed seed, so every run gets the same field.
+	cubePositions.resize(std::min<size_t>(cubeCount, cubePositions.size()));
+	std::mt19937 rng(1234);
+	float fieldSize = 4.0f * std::cbrt((float)cubeCount);
+	std::uniform_real_distribution<float> scatter(-fieldSize, fieldSize);
+	while((int)cubePositions.size() < cubeCount){
+		cubePositions.push_back(glm::vec3(scatter(rng), scatter(rng), scatter(rng) - 5.0f));
+	}
+
+	//Which of objectRanges each cube draws: with --mixed, cubes and meshes take turns
+	std::vector<uint32_t> meshOf(cubeCount, 0);
+	for(int i = 0; mixed && i < cubeCount; i++){
+		meshOf[i] = i % 2;
+	}
+	auto isMesh = [&](int i){ return haveMesh && (!mixed || meshOf[i] == 1); };
+
+	//Model matrix: Object space => World space
+	//The transform store works these out in batches, and only for cubes that changed.
+	TransformStore cubeTransforms;
+	for(int i = 0; i < cubeCount; i++){
+		float angle = 20.0f * i;
+		cubeTransforms.add(cubePositions[i], glm::vec3(1.0f, 0.3f, 0.5f), glm::radians(angle), isMesh(i) ? meshScale : 1.0f);
+	}
+	cubeTransforms.update();
+	const std::vector<glm::mat4> &modelMatrices = cubeTransforms.matrices;
+
+	//Bounding spheres for culling. Spinning doesn't move a cube's center, so these never change.
+	BoundingSpheres cubeBounds;
+	cubeBounds.resize(cubeCount);
+	for(int i = 0; i < cubeCount; i++){
+		glm::vec3 center(cubeTransforms.posX[i], cubeTransforms.posY[i], cubeTransforms.posZ[i]);
+		float radius = isMesh(i) ? objectData.bounds.radius : Cube::boundingRadius;
+		cubeBounds.set(i, center, radius * cubeTransforms.scale[i]);
+	}
+	//Which cubes made it past culling
+	std::vector<uint32_t> visibleCubes;
+	unsigned int culledCameraVersion = 0;
+	bool culledOnce = false;
 
 	//Load shader program
-	ShaderProg shaderProg("/lair/ColdThings/shader_sandbox/src/shaders/vertex.glsl", "/lair/ColdThings/shader_sandbox/src/shaders/fragment.glsl");
-	shaderProg.use();
-	shaderProg.setInt("texture0", 0);
-	shaderProg.setInt("texture1", 1);
+	ShaderProg shaderProg("src/shaders/vertex.glsl", "src/shaders/fragment.glsl");
+	//Undo whatever quantization the vertices went through
+	VertexQuantizer::Dequantization dequantization = VertexQuantizer::identity();
+	if(mesh) dequantization = mesh->dequantization;
+	else if(cube) dequantization = cube->dequantization;
+	int modelMatrixLoc = -1;
+	//Everything the program needs set once. Done again whenever it gets reloaded.
+	auto setupShader = [&](){
+		shaderProg.use();
+		shaderProg.setInt("texture0", 0);
+		shaderProg.setInt("texture1", 1);
+		shaderProg.setBool("instanced", useInstancing);
+		shaderProg.setVec3("positionScale", dequantization.scale);
+		shaderProg.setVec3("positionOffset", dequantization.offset);
+		//Look up the uniforms we set every frame once, up front
+		modelMatrixLoc = shaderProg.uniform("modelMatrix");
+		//The camera matrices come from a uniform buffer shared by every program
+		shaderProg.bindUniformBlock("CameraBlock", CameraUniforms::BINDING);
+	};
+	setupShader();
+	CameraUniforms cameraUniforms;
+	//Edits to the shaders get picked up on a background thread, and the program rebuilt
+	//between frames. A shader that doesn't build leaves the last good program drawing.
+	std::unique_ptr<FileWatcher> shaderWatcher;
+	if(watchShaders){
+		shaderWatcher.reset(new FileWatcher());
+		shaderWatcher->watch(shaderProg.vertexFile());
+		shaderWatcher->watch(shaderProg.fragmentFile());
+	}
+
+	//Everything that gets rewritten every frame (instance matrices, the camera block)
+	//goes into a triple-buffered ring, so we never wait on or reallocate a buffer the GPU is using.
+	FrameRing frameRing(cubeCount * sizeof(glm::mat4) + 64 * 1024);
+	//Turns the visible cubes into one draw command per kind of object
+	DrawCommandBuilder drawCommands;
 
 	//Use depth testing
 	glEnable(GL_DEPTH_TEST);
 
+	//Headless runs draw into an offscreen framebuffer instead of the (invisible) window
+	std::unique_ptr<Framebuffer> offscreen;
+	if(headless){
+		offscreen.reset(new Framebuffer(WIDTH, HEIGHT));
+		offscreen->bind();
+		camera.setViewport(WIDTH, HEIGHT);
+	}
+
+	//The CPU backend draws at the size we start at, and gets stretched if the window changes
+	std::unique_ptr<SoftRasterizer> softRasterizer;
+	std::unique_ptr<SoftPresenter> softPresenter;
+	std::vector<glm::mat4> softInstances;
+	if(software){
+		int softWidth = headless ? WIDTH : framebufferWidth;
+		int softHeight = headless ? HEIGHT : framebufferHeight;
+		softRasterizer.reset(new SoftRasterizer(softWidth, softHeight, &jobs));
+		softPresenter.reset(new SoftPresenter(softWidth, softHeight));
+	}
+
+	//The last frame gets copied back for checking against the golden image while the
+	//GPU's still finishing up, rather than stalling the frame on glReadPixels
+	std::unique_ptr<PixelReadback> goldenReadback;
+	if(!goldenPath.empty()){
+		goldenReadback.reset(new PixelReadback());
+	}
+
+	//Frames get saved at the size we start at
+	std::unique_ptr<FrameCapture> frameCapture;
+	if(!capturePrefix.empty() || !captureCommand.empty()){
+		if(!capturePrefix.empty() && !captureCommand.empty()){
+			std::cout << "WARNING: Both --capture and --capture-pipe given, only piping" << std::endl;
+		}
+		int captureWidth = headless ? WIDTH : framebufferWidth;
+		int captureHeight = headless ? HEIGHT : framebufferHeight;
+		if(!captureCommand.empty()){
+			//If the encoder dies, find out from fwrite rather than being killed along with it.
+			//This goes for the whole process, which is why it's done here and not in FrameCapture.
+			signal(SIGPIPE, SIG_IGN);
+			frameCapture.reset(new FrameCapture(FrameCapture::RAW_PIPE, captureCommand, captureWidth, captureHeight));
+		} else {
+			frameCapture.reset(new FrameCapture(FrameCapture::PNG_SEQUENCE, capturePrefix, captureWidth, captureHeight,
+				FrameCapture::MIN_SLOTS, std::thread::hardware_concurrency(), captureLevel));
+		}
+	}
+
+	std::unique_ptr<Benchmark> benchmark;
+	if(bench){
+		benchmark.reset(new Benchmark());
+	}
+
 	//Render Loop
-	while(!glfwWindowShouldClose(window)){
-		float currentFrame = glfwGetTime();
-		dTime = currentFrame - lastFrame;
-		lastFrame = currentFrame;
+	int frameCount = 0;
+	double startTime = glfwGetTime();
+	while(!glfwWindowShouldClose(window) && (frameLimit == 0 || frameCount < frameLimit)){
+		if(benchmark) benchmark->beginFrame();
+		if(headless){
+			//Fixed timestep and a scripted camera, so every headless run draws the same frames
+			dTime = 1.0f / 60.0f;
+			scriptedCamera(frameCount * dTime);
+		} else {
+			float currentFrame = glfwGetTime();
+			dTime = currentFrame - lastFrame;
+			lastFrame = currentFrame;
+
+			processInput(window);
+		}
 
-		processInput(window);
+		if(textureStreamer){
+			//Push along any uploads in flight, and pick up whatever has finished arriving
+			textureStreamer->update();
+			for(size_t i = 0; i < streamedTextures.size(); i++){
+				textures[i] = textureStreamer->texture(streamedTextures[i]);
+			}
+		}
 
-		glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		frameRing.beginFrame();
+
+		//(The software rasterizer clears its own buffers, and its picture covers the whole window)
+		if(!softRasterizer){
+			glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		}
 
+		if(shaderWatcher && shaderWatcher->changed() && shaderProg.reload()){
+			setupShader();
+		}
 		shaderProg.use();
 
-		//Model matrix: Object space => World space
-		//Defined below at draw step
-		//View matrix: World space => Camera space
-		//"To move a camera backwards, is the same as moving the entire scene forward."
-		glm::mat4 viewMatrix;
-		viewMatrix = glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
-		unsigned int viewMatrixLoc = glGetUniformLocation(shaderProg.ID, "viewMatrix");
-		glUniformMatrix4fv(viewMatrixLoc, 1, GL_FALSE, glm::value_ptr(viewMatrix));
-
-		//Projection matrix: Camera space => Clip space
-		glm::mat4 projectionMatrix;
-		projectionMatrix = glm::perspective(glm::radians(45.0f), (float)WIDTH/(float)HEIGHT, 0.1f, 100.0f); //FOV, aspect ratio, near clipping, far clipping
-		unsigned int projectionMatrixLoc = glGetUniformLocation(shaderProg.ID, "projectionMatrix");
-		glUniformMatrix4fv(projectionMatrixLoc, 1, GL_FALSE, glm::value_ptr(projectionMatrix));
-
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, texture0);
-		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_2D, texture1);
-		glBindVertexArray(cube.VAO);
-		for(int i = 0; i < 10; i++){
-			glm::mat4 modelMatrix = glm::mat4(1.0f);
-			modelMatrix = glm::translate(modelMatrix, cubePositions[i]);
-			float angle = 20.0f * i;
-			modelMatrix = glm::rotate(modelMatrix, glm::radians(angle), glm::vec3(1.0f, 0.3f, 0.5f));
-			shaderProg.setMat4("modelMatrix", modelMatrix);
-
-			glDrawArrays(GL_TRIANGLES, 0, 36);
-		}
-		/* glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0); //Primitive type, number of elements, index type, offset */
-		glBindVertexArray(0);
-
-		glfwSwapBuffers(window);
+		//One upload for every program that uses the camera
+		//(The camera only rebuilds its matrices if it actually moved)
+		float time = headless ? frameCount * dTime : glfwGetTime();
+		cameraUniforms.update(camera, time, &frameRing);
+
+		if(spin){
+			for(int i = 0; i < cubeCount; i++){
+				cubeTransforms.setAngle(i, glm::radians(20.0f * i) + 0.5f * time);
+			}
+		}
+		cubeTransforms.update(&jobs);
+
+		//The cubes never change position, so we only need to cull again when the camera moves
+		bool recull = useCulling && (!culledOnce || camera.version() != culledCameraVersion);
+		if(recull){
+			FrustumCuller::cull(Frustum(camera.viewProjection()), cubeBounds, visibleCubes, &jobs);
+			culledCameraVersion = camera.version();
+			culledOnce = true;
+		}
+		//(modelMatrices is padded out past cubeCount, so go by the count rather than its size)
+		size_t drawCount = useCulling ? visibleCubes.size() : cubeCount;
+
+		if(softRasterizer){
+			//The same objects in the same order, drawn on the CPU instead
+			drawCommands.build(objectRanges, meshOf, useCulling ? visibleCubes.data() : NULL, drawCount);
+			softInstances.resize(drawCount);
+			jobs.parallelFor(drawCount, 4096, [&](size_t begin, size_t end){
+				for(size_t i = begin; i < end; i++){
+					softInstances[i] = modelMatrices[drawCommands.order[i]];
+				}
+			});
+			softRasterizer->clear(glm::vec4(0.2f, 0.3f, 0.3f, 1.0f));
+			for(size_t i = 0; i < drawCommands.commands.size(); i++){
+				const DrawElementsIndirectCommand &command = drawCommands.commands[i];
+				softRasterizer->drawInstanced(objectBlobs[drawCommands.commandMesh[i]], &softInstances[command.baseInstance],
+						command.instanceCount, camera.viewProjection(), &softTextures[0]);
+			}
+			softRasterizer->finish();
+			int targetWidth = WIDTH, targetHeight = HEIGHT;
+			if(!headless) glfwGetFramebufferSize(window, &targetWidth, &targetHeight);
+			softPresenter->present(*softRasterizer, targetWidth, targetHeight);
+		} else {
+			glActiveTexture(GL_TEXTURE0);
+			glBindTexture(GL_TEXTURE_2D, textures[0]);
+			glActiveTexture(GL_TEXTURE1);
+			glBindTexture(GL_TEXTURE_2D, textures[1]);
+			glBindVertexArray(mesh ? mesh->VAO : (cube ? cube->VAO : arena.VAO));
+			if(useInstancing){
+				//This frame's instance matrices go straight into the ring, filled in on every core.
+				//Arena objects get sorted by kind first, so each kind's instances are together.
+				const uint32_t* order = useCulling ? visibleCubes.data() : NULL;
+				if(!objectRanges.empty()){
+					drawCommands.build(objectRanges, meshOf, order, drawCount);
+					drawCommands.upload(frameRing);
+					order = drawCommands.order.data();
+				}
+				FrameRing::Allocation instances = frameRing.allocate(drawCount * sizeof(glm::mat4), sizeof(glm::mat4));
+				if(instances.data){
+					glm::mat4* instanceMatrices = (glm::mat4*)instances.data;
+					jobs.parallelFor(drawCount, 4096, [&](size_t begin, size_t end){
+						for(size_t i = begin; i < end; i++){
+							instanceMatrices[i] = modelMatrices[order ? order[i] : i];
+						}
+					});
+					frameRing.flush();
+					if(mesh){
+						mesh->setInstanceBuffer(frameRing.buffer, instances.offset, drawCount);
+						mesh->drawInstanced();
+					} else if(cube){
+						cube->setInstanceBuffer(frameRing.buffer, instances.offset, drawCount);
+						cube->drawInstanced();
+					} else {
+						drawCommands.submit(arena, frameRing, instances.offset);
+					}
+				}
+			} else {
+				frameRing.flush();
+				for(size_t i = 0; i < drawCount; i++){
+					uint32_t object = useCulling ? visibleCubes[i] : i;
+					shaderProg.setMat4(modelMatrixLoc, modelMatrices[object]);
+					if(mesh) mesh->draw();
+					else if(cube) cube->draw();
+					else arena.draw(objectRanges[meshOf[object]]);
+				}
+			}
+			glBindVertexArray(0);
+		}
+		frameRing.endFrame();
+
+		if(benchmark) benchmark->endRender();
+		if(goldenReadback && frameCount == frameLimit - 1){
+			goldenReadback->start(0, 0, WIDTH, HEIGHT);
+		}
+		if(frameCapture) frameCapture->capture();
+		if(headless){
+			glFlush();
+		} else {
+			glfwSwapBuffers(window);
+		}
+		if(benchmark) benchmark->endFrame();
 		glfwPollEvents();
+		frameCount++;
 	}
 
-
+	if(headless){
+		glFinish(); //Don't stop the clock until the GPU has actually finished
+		double elapsed = glfwGetTime() - startTime;
+		std::cout << "Renderer: " << glGetString(GL_RENDERER) << "\n"
+			<< "Frames: " << frameCount << " in " << elapsed << " s\n"
+			<< "Mean frame time: " << 1000.0 * elapsed / frameCount << " ms ("
+			<< frameCount / elapsed << " fps)" << std::endl;
+	}
+	if(benchmark){
+		benchmark->finish();
+		benchmark->report(std::cout);
+		std::string label = std::to_string(cubeCount) + " cubes" + (useInstancing ? ", instanced" : "");
+		if(!benchCSV.empty()) benchmark->writeCSV(benchCSV);
+		if(!benchJSON.empty()) benchmark->writeJSON(benchJSON, label);
+	}
+	if(frameCapture){
+		//(Outside the timings: this waits for whatever's still being written)
+		frameCapture->finish();
+		std::cout << "Captured " << frameCapture->framesCaptured() << " frames, dropped " << frameCapture->framesDropped() << std::endl;
+		frameCapture.reset();
+	}
+	int exitCode = 0;
+	if(goldenReadback){
+		const unsigned char* pixels = goldenReadback->map();
+		if(!pixels || !checkGolden(goldenPath, pixels, WIDTH, HEIGHT, updateGolden, goldenMinPSNR, goldenMaxError)){
+			exitCode = 1;
+		}
+		goldenReadback.reset();
+	}
 
 	glfwTerminate();
-	return 0;
+	return exitCode;
+}
+
+//Compares a frame (RGBA8, bottom row first) with the golden image at path and says how it went.
+//With update set, writes the frame as the golden image instead.
+bool checkGolden(const std::string &path, const unsigned char* pixels, int width, int height,
+		bool update, double minPSNR, int maxError){
+	if(update){
+		if(!PNGWriter::write(path, pixels, width, height, 4, width * 4, true, true)) return false;
+		std::cout << "Golden image: wrote " << path << std::endl;
+		return true;
+	}
+	//A missing golden image is a failure, not a pass: otherwise a fresh checkout (or a
+	//mistyped path) would never catch anything
+	FILE* existing = fopen(path.c_str(), "rb");
+	if(!existing){
+		std::cout << "ERROR: No golden image at " << path << " (make one with --update-golden)" << std::endl;
+		return false;
+	}
+	fclose(existing);
+
+	//(decode() flips it bottom row first, like the frame, and expands RGB to RGBA)
+	Image golden = TextureLoader::decode(path);
+	bool sameShape = golden.data && golden.channels == 4 && golden.bytesPerChannel == 1 &&
+		golden.width == width && golden.height == height;
+	if(!sameShape){
+		std::cout << "ERROR: Golden image " << path << " isn't an 8-bit RGB(A) " << width << "x" << height << " image" << std::endl;
+		golden.release();
+		return false;
+	}
+	ImageDiff diff = ImageCompare::compare((const uint32_t*)pixels, (const uint32_t*)golden.data, (size_t)width * height);
+	golden.release();
+	bool pass = diff.psnr >= minPSNR && diff.maxError <= maxError;
+	std::cout << "Golden image: " << (pass ? "PASS" : "FAIL") << " against " << path << "\n"
+		<< "  PSNR " << diff.psnr << " dB (at least " << minPSNR << "), max error " << diff.maxError
+		<< " (at most " << maxError << "), " << diff.pixelsDifferent << " pixels differ" << std::endl;
+	return pass;
 }
 
 //Callback for when the window is resized
 void framebuffer_size_callback(GLFWwindow* window, int width, int height){
 	glViewport(0,0,width,height);
+	camera.setViewport(width, height);
 }
 
 void processInput(GLFWwindow* window){
 	float cameraSpeed = 2.5f * dTime;
 	if(glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS){
-		cameraPos += cameraSpeed * cameraFront;
+		camera.move(cameraSpeed * camera.front());
 	}
 	if(glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS){
-		cameraPos -= glm::normalize(glm::cross(cameraFront, cameraUp)) * cameraSpeed;
+		camera.move(-camera.right() * cameraSpeed);
 	}
 	if(glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS){
-		cameraPos -= cameraSpeed * cameraFront;
+		camera.move(-cameraSpeed * camera.front());
 	}
 	if(glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS){
-		cameraPos += glm::normalize(glm::cross(cameraFront, cameraUp)) * cameraSpeed;
+		camera.move(camera.right() * cameraSpeed);
 	}
 
 
@@ -168,37 +660,12 @@ GLFWwindow* setupWindow(int x, int y, int width, int height, const char* title){
 	return window;
 }
 
-unsigned int loadTextures(const char* filepath){
-	//Load a texture using the stb_image library and put it in an OpenGL texture
-	unsigned int texture;
-	glGenTextures(1, &texture);
-	glBindTexture(GL_TEXTURE_2D, texture);
-
-	//Set texture wrapping/filtering options
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR); //MAG for magnification
-
-	int width, height, nrChannels;
-	stbi_set_flip_vertically_on_load(true);
-	unsigned char* data = stbi_load(filepath, &width, &height, &nrChannels, 0);
-	if(data){
-		glTexImage2D(GL_TEXTURE_2D, //Texture target
-				0, //Mipmap level for if you want to do those manually. (instead of that, we generate them below.)
-				GL_RGB, //Texture storage format
-				width, //We got the width and height values from the image
-				height,//when we loaded it above, so we're using those.
-				0, //Always 0. Legacy thingy.
-				GL_RGB, //Source image format
-				GL_UNSIGNED_BYTE, //Source image data type
-				data); //The actual image data
-		glGenerateMipmap(GL_TEXTURE_2D);
-	} else {
-		std::cout << "Failed to load texture" << std::endl;
-	}
-	stbi_image_free(data); //We're done with the loaded image file now.
-	return texture;	
+//Deterministic camera path for headless runs: a slow orbit around the cube field
+void scriptedCamera(float time){
+	const glm::vec3 center = glm::vec3(0.0f, 0.0f, -5.0f);
+	float angle = 0.5f * time;
+	camera.setPosition(center + glm::vec3(sin(angle) * 10.0f, 2.0f, cos(angle) * 10.0f));
+	camera.lookAt(center);
 }
 
 void mouse_callback(GLFWwindow* window, double xpos, double ypos){
@@ -218,21 +685,5 @@ void mouse_callback(GLFWwindow* window, double xpos, double ypos){
 	xoffset *= sensitivity;
 	yoffset *= sensitivity;
 
-	yaw += xoffset;
-	pitch += yoffset;
-
-	//Don't allow the camera to flip over backwards or forwards
-	if(pitch > 89.0f) pitch = 89.0f;
-	if(pitch < -89.0f) pitch = -89.0f;
-
-	glm::vec3 direction;
-	//The math: Treat our facing direction as the hypotenuse of a right triangle,
-	//	and also suppose it's a normal vector with length 1.
-	//	Since the hypotenuse is 1, len(x) = cos theta and len(y) = sin theta.
-	//	("adjacent/hypotenuse" becomes "adjacent/1" becomes "adjacent", and so forth)
-	//	We have to consider both pitch and yaw, though.
-	direction.x = cos(glm::radians(yaw)) * cos(glm::radians(pitch));
-	direction.y = sin(glm::radians(pitch));
-	direction.z = sin(glm::radians(yaw)) * cos(glm::radians(pitch));
-	cameraFront = glm::normalize(direction);
+	camera.rotate(xoffset, yoffset);
 }
@@ -1,17 +1,31 @@
 #version 330 core
 layout(location = 0) in vec3 aPos;
 layout(location = 1) in vec2 aTexCoord;
+layout(location = 2) in mat4 aInstanceMatrix; //Takes up locations 2 through 5
 
 out vec3 vertColor;
 out vec2 TexCoord;
 
 uniform mat4 modelMatrix;
-uniform mat4 viewMatrix;
-uniform mat4 projectionMatrix;
+//Filled in once per frame and shared by every program (see camerauniforms.h)
+layout(std140) uniform CameraBlock{
+	mat4 viewMatrix;
+	mat4 projectionMatrix;
+	mat4 viewProjectionMatrix;
+	vec4 cameraPos;
+	float time;
+};
+uniform bool instanced; //Take the model matrix from the instance buffer instead of the uniform
+//Quantized vertices come in as 0-1 across the object's bounding box (see quantize.h).
+//For plain float vertices these are just 1 and 0.
+uniform vec3 positionScale;
+uniform vec3 positionOffset;
 
 void main()
 {
-	gl_Position = projectionMatrix * viewMatrix * modelMatrix * vec4(aPos, 1.0);
+	mat4 model = instanced ? aInstanceMatrix : modelMatrix;
+	vec3 position = aPos * positionScale + positionOffset;
+	gl_Position = viewProjectionMatrix * model * vec4(position, 1.0);
 	TexCoord = aTexCoord;
 }
 